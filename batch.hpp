@@ -0,0 +1,371 @@
+/**
+ * @file batch.hpp
+ *
+ * Running many simulations: batch mode, which parses the tables once and runs
+ * every trace of a manifest concurrently on a work-stealing thread pool; and
+ * Monte Carlo replications and parameter sweeps of one trace on the same pool.
+ */
+
+#ifndef BATCH_HPP_
+#define BATCH_HPP_
+
+#include <simulation.hpp>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+/**
+ * \brief thread pool that balances a fixed set of tasks by work stealing
+ *
+ * Tasks are dealt out to per-worker queues up front. A worker runs tasks from
+ * the back of its own queue and, once that is empty, steals from the front of
+ * the others', so long traces do not leave the other cores idle.
+ *
+ */
+class work_stealing_pool {
+public:
+    work_stealing_pool(size_t workers): queues(workers ? workers : 1) {}
+
+    size_t size() const {
+        return queues.size();
+    }
+
+    //Runs task(i) for every i below count; returns once all of them have run
+    void run(size_t count, const std::function<void(size_t)>& task) {
+        for (size_t i = 0; i < count; i++) {
+            queues[i % queues.size()].tasks.push_back(i);
+        }
+
+        std::vector<std::thread> threads;
+        for (size_t worker = 0; worker < queues.size(); worker++) {
+            threads.emplace_back([this, worker, &task]() {
+                size_t next;
+                while (take(worker, next)) {
+                    task(next);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+private:
+    struct worker_queue {
+        std::mutex          lock;
+        std::deque<size_t>  tasks;
+    };
+
+    //Next task of worker: its own newest, or the oldest task of another worker
+    bool take(size_t worker, size_t& task) {
+        for (size_t i = 0; i < queues.size(); i++) {
+            worker_queue& queue = queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            if (i == 0) {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+            } else {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+            }
+            return true;
+        }
+        return false; // no task is ever added while running: every queue is empty for good
+    }
+
+    std::deque<worker_queue> queues;
+};
+
+//Threads to run tasks on: --jobs, or one per core, but no more than there are tasks
+size_t worker_count(const sim_options& options, size_t tasks) {
+    size_t workers = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    return std::min(workers, std::max<size_t>(tasks, 1));
+}
+
+//Reads a batch manifest: one trace file per line; blank lines and lines starting with # are skipped
+std::vector<std::string> read_manifest(const std::string& filename) {
+    mapped_file manifest(filename);
+    if (!manifest.is_open()) {
+        std::cerr << "Error: Unable to open file: " << filename << std::endl;
+        exit(1);
+    }
+
+    std::vector<std::string> traces;
+    std::string_view line;
+    line_reader lines(manifest.contents());
+    while (lines.next(line)) {
+        while (!line.empty() && isspace((unsigned char)line.back())) {
+            line.remove_suffix(1);
+        }
+        if (!line.empty() && line[0] != '#') {
+            traces.emplace_back(line);
+        }
+    }
+    return traces;
+}
+
+/**
+ * \brief runs every trace of a manifest
+ *
+ * Each trace writes <name>_execution.txt (or .bin), <name>_system_status.txt
+ * and <name>_report.txt into the output directory, where name is the trace's
+ * file name without extension, suffixed with its manifest index (again, if
+ * need be) while another trace already has it. Trace i uses seed + i for its random delays.
+ *
+ * @return whether every trace ran
+ */
+bool run_batch(const std::string& manifest, const sim_tables& tables, const sim_options& options, unsigned int seed) {
+    std::vector<std::string> traces = read_manifest(manifest);
+
+    std::error_code error;
+    std::filesystem::create_directories(options.output_dir, error);
+    if (error) {
+        std::cerr << "Error: Unable to create directory: " << options.output_dir << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> names;
+    std::unordered_set<std::string> taken;  //every name handed out, suffixed ones included
+    for (size_t i = 0; i < traces.size(); i++) {
+        std::string name = std::filesystem::path(traces[i]).stem().string();
+        while (!taken.insert(name).second) {
+            name += "_" + std::to_string(i);
+        }
+        names.push_back(name);
+    }
+
+    work_stealing_pool pool(worker_count(options, traces.size()));
+    std::vector<char> ran(traces.size(), false);
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(traces.size(), [&](size_t i) {
+        // Opened before the simulator, so a trace that cannot be read leaves no outputs behind
+        mapped_file input_file(traces[i]);
+        if (!input_file.is_open()) {
+            std::cerr << "Error: Unable to open file: " << traces[i] << std::endl;
+            return;
+        }
+
+        std::filesystem::path base = std::filesystem::path(options.output_dir) / names[i];
+        std::ofstream report(base.string() + "_report.txt");
+        simulator run(tables, options, seed + i,
+                      base.string() + (options.binary_output ? "_execution.bin" : "_execution.txt"),
+                      base.string() + "_system_status.txt");
+        ran[i] = run.run(input_file.contents(), report);
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0;
+    for (size_t i = 0; i < traces.size(); i++) {
+        if (!ran[i]) {
+            std::cerr << "ERROR! " << traces[i] << " did not run" << std::endl;
+            failed++;
+        }
+    }
+
+    std::cout << "Batch: " << traces.size() << " trace(s) on " << pool.size() << " thread(s) in " << seconds
+              << " s, " << failed << " failed" << std::endl;
+    std::cout << "Check " << options.output_dir << " for results." << std::endl;
+    return failed == 0;
+}
+
+//Two-sided 95% quantile of Student's t with df degrees of freedom: tabulated up to 30,
+//then the Cornish-Fisher expansion around the normal quantile, which is within 0.001 of it
+double t_quantile_95(size_t df) {
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if (df <= sizeof(table) / sizeof(table[0])) {
+        return table[df - 1];
+    }
+    const double z = 1.959964;
+    double z3 = z * z * z, z5 = z3 * z * z;
+    return z + (z3 + z) / (4.0 * df) + (5 * z5 + 16 * z3 + 3 * z) / (96.0 * df * df);
+}
+
+//Writes one row of the replications report: mean, percentiles and the 95% confidence interval of the mean
+void write_distribution(std::ostream& out, const std::string& label, std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    auto percentile = [&](double p) { //linear interpolation between the closest ranks
+        double rank = p * (n - 1);
+        size_t below = (size_t)std::floor(rank), above = (size_t)std::ceil(rank);
+        return samples[below] + (rank - below) * (samples[above] - samples[below]);
+    };
+
+    double mean = 0;
+    for (double sample : samples) {
+        mean += sample;
+    }
+    mean /= n;
+    double variance = 0;
+    for (double sample : samples) {
+        variance += (sample - mean) * (sample - mean);
+    }
+    double half_width = n > 1 ? t_quantile_95(n - 1) * std::sqrt(variance / (n - 1) / n) : 0.0;
+
+    std::ostringstream row;
+    row << std::left << std::setw(32) << label << std::right << std::fixed << std::setprecision(1)
+        << std::setw(12) << mean << std::setw(12) << percentile(0.05) << std::setw(12) << percentile(0.5)
+        << std::setw(12) << percentile(0.95) << "   [" << mean - half_width << ", " << mean + half_width << "]";
+    out << row.str() << std::endl;
+}
+
+/**
+ * \brief Monte Carlo replications of one trace
+ *
+ * Replication r runs the trace with seed + r, on the work-stealing pool, with
+ * the same simulator as a single run: a replication matches the single run
+ * with --seed seed + r. Events are only tallied, so nothing is written per
+ * replication. Reports the distribution of the completion time and of the
+ * total time of each event type: mean, 5th, 50th and 95th percentiles, and
+ * the 95% confidence interval of the mean (Student's t, so it holds for few
+ * replications too).
+ *
+ * @return whether every replication ran
+ */
+bool run_replications(const std::string& trace_path, const sim_tables& tables, const sim_options& options,
+                      unsigned int seed) {
+    mapped_file input_file(trace_path);
+    if (!input_file.is_open()) {
+        std::cerr << "Error: Unable to open file: " << trace_path << std::endl;
+        return false;
+    }
+
+    // Compiled once, so malformed lines are reported once; every replica copies these tables
+    sim_tables compiled_tables = tables;
+    compiled_trace trace_file = compile_trace(input_file.contents(), compiled_tables.registry.programs,
+                                              interrupt_count(tables.vectors, tables.delays));
+
+    size_t replications = options.replications;
+    std::vector<event_tally> tallies(replications);
+    std::vector<int> end_times(replications);
+    std::vector<char> ran(replications, false);
+    work_stealing_pool pool(worker_count(options, replications));
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(replications, [&](size_t r) {
+        simulator replica(compiled_tables, options, seed + r, "", "", &tallies[r]);
+        ran[r] = replica.simulate(trace_file);
+        end_times[r] = replica.end_time();
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (std::count(ran.begin(), ran.end(), false)) {
+        std::cerr << "ERROR! " << std::count(ran.begin(), ran.end(), false) << " replication(s) did not run" << std::endl;
+        return false;
+    }
+
+    std::cout << "Monte Carlo: " << replications << " replication(s) of " << trace_path << " on " << pool.size()
+              << " thread(s) in " << seconds << " s, seeds " << seed << " to " << (unsigned int)(seed + replications - 1) << std::endl;
+    std::cout << std::left << std::setw(32) << "time (ms)" << std::right << std::setw(12) << "mean"
+              << std::setw(12) << "p5" << std::setw(12) << "p50" << std::setw(12) << "p95" << "   95% CI" << std::endl;
+
+    write_distribution(std::cout, "completion time", std::vector<double>(end_times.begin(), end_times.end()));
+    for (size_t event = 0; event < (size_t)log_event::EVENT_COUNT; event++) {
+        bool seen = false;
+        std::vector<double> totals;
+        for (const event_tally& tally : tallies) {
+            seen = seen || tally.count[event] > 0;
+            totals.push_back(tally.time[event]);
+        }
+        if (seen) {
+            write_distribution(std::cout, event_messages[event], totals);
+        }
+    }
+    return true;
+}
+
+/**
+ * \brief parameter sweep over the context save time and the EXEC load rate
+ *
+ * Compiles the trace once, then runs every combination of the two grids on
+ * the work-stealing pool. A grid not given is just the configured value. All
+ * grid points use the same seed, so they differ only in their parameters.
+ * Events are only tallied. Writes one CSV row per grid point: the parameters,
+ * the total runtime, and the kernel overhead (the time of every event but CPU
+ * bursts and idling) in ms and as a share of the runtime.
+ *
+ * @return whether every grid point ran
+ */
+bool run_sweep(const std::string& trace_path, const sim_tables& tables, const sim_options& options,
+               unsigned int seed) {
+    mapped_file input_file(trace_path);
+    if (!input_file.is_open()) {
+        std::cerr << "Error: Unable to open file: " << trace_path << std::endl;
+        return false;
+    }
+
+    // Every grid point copies these tables, so the compiled trace's program ids hold for all of them
+    sim_tables compiled_tables = tables;
+    compiled_trace trace_file = compile_trace(input_file.contents(), compiled_tables.registry.programs,
+                                              interrupt_count(tables.vectors, tables.delays));
+
+    std::vector<int> save_times = options.sweep_context_save;
+    std::vector<int> load_rates = options.sweep_load_rate;
+    if (save_times.empty()) {
+        save_times.push_back(options.context_save_time);
+    }
+    if (load_rates.empty()) {
+        load_rates.push_back(options.load_rate);
+    }
+
+    size_t points = save_times.size() * load_rates.size();
+    std::vector<event_tally> tallies(points);
+    std::vector<int> end_times(points);
+    std::vector<char> ran(points, false);
+    work_stealing_pool pool(worker_count(options, points));
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(points, [&](size_t p) {
+        sim_options point = options;
+        point.context_save_time = save_times[p / load_rates.size()];
+        point.load_rate = load_rates[p % load_rates.size()];
+
+        simulator run(compiled_tables, point, seed, "", "", &tallies[p]);
+        ran[p] = run.simulate(trace_file);
+        end_times[p] = run.end_time();
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ofstream csv(options.sweep_output);
+    if (!csv.is_open()) {
+        std::cerr << "Error: Unable to open file: " << options.sweep_output << std::endl;
+        return false;
+    }
+
+    csv << "context_save_ms,load_rate_ms_per_mb,total_runtime_ms,kernel_overhead_ms,kernel_overhead_percent\n";
+    size_t failed = 0;
+    for (size_t p = 0; p < points; p++) {
+        if (!ran[p]) {
+            failed++;
+            continue;
+        }
+
+        int64_t kernel = 0;
+        for (size_t event = 0; event < (size_t)log_event::EVENT_COUNT; event++) {
+            if (event != (size_t)log_event::CPU_BURST && event != (size_t)log_event::CPU_IDLE) {
+                kernel += tallies[p].time[event];
+            }
+        }
+        csv << save_times[p / load_rates.size()] << "," << load_rates[p % load_rates.size()] << "," << end_times[p]
+            << "," << kernel << "," << (end_times[p] ? 100.0 * kernel / end_times[p] : 0.0) << "\n";
+    }
+
+    std::cout << "Sweep: " << points << " grid point(s) of " << trace_path << " on " << pool.size() << " thread(s) in "
+              << seconds << " s, seed " << seed << ", " << failed << " failed" << std::endl;
+    std::cout << "Check " << options.sweep_output << " for results." << std::endl;
+    return failed == 0;
+}
+
+#endif
@@ -0,0 +1,391 @@
+/**
+ * @file benchmarks.cpp
+ *
+ * Benchmarks for the simulator. Run ./benchmarks <name> to run a single
+ * benchmark, or ./benchmarks with no arguments to run all of them.
+ */
+
+#include <simulator.hpp>
+#include <events.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <new>
+
+// Global allocation counters, fed by the operator new replacement below. The
+// replacements are never inlined: inlined malloc/free pairs trip g++'s
+// -Wmismatched-new-delete at every new/delete of the headers.
+size_t allocation_count = 0;
+size_t allocation_bytes = 0;
+
+__attribute__((noinline)) void* operator new(std::size_t size) {
+    allocation_count++;
+    allocation_bytes += size;
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+//Writes lines to a file in the current directory
+void write_lines(const std::string& filename, const std::vector<std::string>& lines) {
+    std::ofstream output_file(filename);
+    for (const auto& line : lines) {
+        output_file << line << "\n";
+    }
+}
+
+/**
+ * Deep FORK/EXEC trace: `depth` FORKs nested inside each other's child section,
+ * the innermost child starting a chain of `chain` programs that each EXEC the next.
+ * Allocation counts show how much memory traffic every nesting level costs.
+ */
+void bench_deep_fork_exec() {
+    const int depth = 200;
+    const int chain = 200;
+    const int padding_files = 1000;
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "interrupts_bench";
+    std::filesystem::create_directories(dir);
+    std::filesystem::path old_dir = std::filesystem::current_path();
+    std::filesystem::current_path(dir);
+
+    std::vector<std::string> trace_lines;
+    std::string trace_text;
+    for (int i = 0; i < depth; i++) {
+        trace_lines.push_back("FORK, 1");
+        trace_lines.push_back("IF_CHILD, 0");
+    }
+    trace_lines.push_back("EXEC chain0, 1");
+    for (int i = 0; i < depth; i++) {
+        trace_lines.push_back("IF_PARENT, 0");
+        trace_lines.push_back("CPU, 1");
+        trace_lines.push_back("ENDIF, 0");
+    }
+
+    program_registry external_files;
+    for (int i = 0; i < padding_files; i++) {
+        external_files.add({"padding" + std::to_string(i), 5});
+    }
+    for (int i = 0; i < chain; i++) {
+        std::vector<std::string> program = {"CPU, 1"};
+        if (i + 1 < chain) {
+            program.push_back("EXEC chain" + std::to_string(i + 1) + ", 1");
+        }
+        write_lines("chain" + std::to_string(i) + ".txt", program);
+        external_files.add({"chain" + std::to_string(i), 1});
+    }
+
+    std::vector<std::string> vectors(26, "0X0000");
+    std::vector<int> delays(26, 100);
+
+    for (const auto& line : trace_lines) {
+        trace_text += line + "\n";
+    }
+    compiled_trace trace_file = compile_trace(trace_text, external_files.programs, interrupt_count(vectors, delays));
+    std::vector<std::string> positions = vector_positions(vectors.size());
+    program_cache cache;
+    sim_state state;
+    sim_context context{vectors, delays, external_files, cache, state};
+
+    PCB current(0, -1, "init", 1, -1);
+    allocate_memory(state, &current);
+    std::vector<PCB> wait_queue;
+
+    size_t count_before = allocation_count;
+    size_t bytes_before = allocation_bytes;
+    auto start = std::chrono::steady_clock::now();
+
+    output_sink execution_output;
+    output_sink system_status;
+    execution_log execution(execution_output, vectors, positions);
+    int end_time = simulate_trace(context, trace_file, 0, 0, current, wait_queue, execution, system_status);
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    free_memory(state, &current);
+    std::filesystem::current_path(old_dir);
+    std::filesystem::remove_all(dir);
+
+    std::cout << "deep_fork_exec: depth " << depth << ", chain " << chain
+              << ", " << external_files.files.size() << " external files" << std::endl;
+    std::cout << "  allocations: " << allocation_count - count_before << std::endl;
+    std::cout << "  bytes allocated: " << allocation_bytes - bytes_before << std::endl;
+    std::cout << "  simulated time: " << end_time << ", log size: " << execution_output.size() << std::endl;
+    std::cout << "  wall time: " << elapsed.count() << " ms" << std::endl;
+}
+
+/**
+ * Throughput of the four interrupt boilerplate lines, written into a discarding
+ * sink so only formatting and buffering are measured, in text and binary form.
+ */
+void bench_boilerplate() {
+    const int iterations = 2000000;
+
+    std::vector<std::string> vectors(26, "0X01E3");
+    std::vector<std::string> positions = vector_positions(vectors.size());
+
+    for (bool binary : {false, true}) {
+        output_sink execution_output;
+        execution_log execution(execution_output, vectors, positions, binary);
+
+        size_t count_before = allocation_count;
+        auto start = std::chrono::steady_clock::now();
+
+        int current_time = 0;
+        for (int i = 0; i < iterations; i++) {
+            current_time = intr_boilerplate(execution, current_time, i % vectors.size(), 10);
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "boilerplate (" << (binary ? "binary" : "text") << "): " << iterations << " interrupts, "
+                  << execution_output.size() << " bytes" << std::endl;
+        std::cout << "  allocations: " << allocation_count - count_before << std::endl;
+        std::cout << "  lines per second: " << (4.0 * iterations) / seconds << std::endl;
+    }
+}
+
+/**
+ * Fixed partition allocator: allocate/free pairs with a third of the partitions
+ * kept occupied so the search has to skip over them, on the default six
+ * partitions and on a table of 100000 partitions. Programs are sized like the
+ * free partitions, so every allocation succeeds and the rate is one of full
+ * searches, not of early failures.
+ */
+void bench_partitions() {
+    const int iterations = 10000000;
+
+    std::vector<unsigned int> large_layout;
+    std::mt19937 generator(1);
+    for (int i = 0; i < 100000; i++) {
+        large_layout.push_back(generator() % 64 + 1);
+    }
+
+    const std::vector<unsigned int>* layouts[] = {&default_partition_sizes, &large_layout};
+    for (const auto* layout : layouts) {
+        partition_table table(*layout);
+
+        std::vector<int> residents;
+        for (size_t i = 0; i < table.size() / 3 + 1; i++) {
+            residents.push_back(table.allocate((*layout)[(i * 7) % layout->size()], "resident"));
+        }
+
+        std::vector<unsigned int> free_sizes;
+        for (const auto& partition : table.partitions) {
+            if (partition.code.empty()) {
+                free_sizes.push_back(partition.size);
+            }
+        }
+        std::vector<unsigned int> sizes;
+        for (size_t i = 0; i < 1024; i++) {
+            sizes.push_back(free_sizes[generator() % free_sizes.size()]);
+        }
+
+        size_t failures = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < iterations; i++) {
+            int partition_number = table.allocate(sizes[i % sizes.size()], "program");
+            if (partition_number >= 0) {
+                table.release(partition_number);
+            } else {
+                failures++;
+            }
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "partitions (" << table.size() << " partitions): " << iterations << " allocate/free pairs, "
+                  << failures << " failed" << std::endl;
+        std::cout << "  pairs per second: " << iterations / seconds << std::endl;
+    }
+}
+
+//Random mix of allocations (1 to max_size Mb) and frees of random live blocks; returns the failed allocations.
+//With compact, a failed allocation compacts memory and is retried, like EXEC does with --compaction.
+size_t random_workload(memory_manager& memory, int iterations, unsigned int max_size, bool compact = false) {
+    std::mt19937 generator(1);
+    std::vector<int> live;
+    size_t failures = 0;
+
+    for (int i = 0; i < iterations; i++) {
+        if (!live.empty() && generator() % 2) {
+            size_t k = generator() % live.size();
+            memory.release(live[k]);
+            live[k] = live.back();
+            live.pop_back();
+        } else {
+            unsigned int size = generator() % max_size + 1;
+            int handle = memory.allocate(size, "program");
+            if (handle < 0 && compact && memory.compact(size) > 0) {
+                handle = memory.allocate(size, "program");
+            }
+            if (handle >= 0) {
+                live.push_back(handle);
+            } else {
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+/**
+ * Variable partitions: the random workload in 1000 Mb for every fit policy,
+ * with the fragmentation it leaves behind.
+ */
+void bench_variable_fit() {
+    const int iterations = 2000000;
+    const char* names[] = {"first", "best", "worst", "next"};
+
+    for (fit_policy policy : {fit_policy::FIRST, fit_policy::BEST, fit_policy::WORST, fit_policy::NEXT}) {
+        variable_memory memory(1000, policy);
+
+        auto start = std::chrono::steady_clock::now();
+        size_t failures = random_workload(memory, iterations, 40);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "variable_fit (" << names[(int)policy] << "): " << iterations << " operations, "
+                  << failures << " failed allocations" << std::endl;
+        std::cout << "  operations per second: " << iterations / seconds << std::endl;
+        memory.report(std::cout);
+    }
+}
+
+/**
+ * Compaction: the variable_fit workload with first fit, compacting memory and
+ * retrying whenever an allocation fails with enough free memory in total.
+ */
+void bench_compaction() {
+    const int iterations = 2000000;
+
+    variable_memory memory(1000, fit_policy::FIRST);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t failures = random_workload(memory, iterations, 40, true);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "compaction (first): " << iterations << " operations, " << failures
+              << " allocations failed after compaction" << std::endl;
+    std::cout << "  operations per second: " << iterations / seconds << std::endl;
+    memory.report(std::cout);
+}
+
+/**
+ * Buddy allocator: the random workload in 1 Gb (the same load as variable_fit)
+ * and in 16 Tb with programs up to 64 Gb, to show the cost does not grow with
+ * the memory size.
+ */
+void bench_buddy() {
+    const int iterations = 2000000;
+    const std::pair<unsigned int, unsigned int> setups[] = {{1u << 10, 40}, {1u << 24, 1u << 16}};
+
+    for (const auto& [total_size, max_size] : setups) {
+        buddy_memory memory(total_size);
+
+        auto start = std::chrono::steady_clock::now();
+        size_t failures = random_workload(memory, iterations, max_size);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "buddy (" << total_size << " Mb): " << iterations << " operations, "
+                  << failures << " failed allocations" << std::endl;
+        std::cout << "  operations per second: " << iterations / seconds << std::endl;
+        memory.report(std::cout);
+    }
+}
+
+/**
+ * Paged memory: page references of a 4096 page program in 1024 frames with a
+ * 64 entry TLB, for every replacement policy. Every policy is O(1) per
+ * reference, so throughput should not depend on the frame count.
+ */
+void bench_paging() {
+    const int references = 10000000;
+    const char* names[] = {"fifo", "clock", "lfu"};
+
+    for (replacement_policy policy : {replacement_policy::FIFO, replacement_policy::CLOCK, replacement_policy::LFU}) {
+        paged_memory memory(1024, 1, 64, policy);
+        int handle = memory.allocate(4096, "program");
+
+        size_t faults = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < references; i++) {
+            unsigned int page;
+            faults += memory.touch(handle, page) == page_access::PAGE_FAULT;
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "paging (" << names[(int)policy] << "): " << references << " references, "
+                  << faults << " faults" << std::endl;
+        std::cout << "  references per second: " << references / seconds << std::endl;
+    }
+}
+
+/**
+ * Event calendar: the hold model with a thousand to four million pending
+ * events. Every operation fires the earliest event and schedules a new one up
+ * to a second later, so the number of pending events stays the same.
+ */
+void bench_events() {
+    const int operations = 10000000;
+
+    for (int pending : {1000, 1000000, 4000000}) {
+        std::mt19937 generator(1);
+        event_calendar calendar;
+        for (int i = 0; i < pending; i++) {
+            calendar.schedule(generator() % 1000000, event_type::IO_COMPLETE, i, 0);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < operations; i++) {
+            sim_event event = calendar.pop();
+            calendar.schedule(event.time + generator() % 1000 + 1, event.type, event.process, event.device);
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "events (" << calendar.size() << " pending): " << operations << " events, simulated time "
+                  << calendar.next_time() << std::endl;
+        std::cout << "  events per second: " << operations / seconds << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::pair<std::string, std::function<void()>>> benchmarks = {
+        {"deep_fork_exec", bench_deep_fork_exec},
+        {"boilerplate", bench_boilerplate},
+        {"partitions", bench_partitions},
+        {"variable_fit", bench_variable_fit},
+        {"compaction", bench_compaction},
+        {"buddy", bench_buddy},
+        {"paging", bench_paging},
+        {"events", bench_events},
+    };
+
+    bool ran = false;
+    for (const auto& [name, bench] : benchmarks) {
+        if (argc < 2 || name == argv[1]) {
+            bench();
+            ran = true;
+        }
+    }
+
+    if (!ran) {
+        std::cerr << "Unknown benchmark: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -3,4 +3,6 @@ if [ ! -d "bin" ]; then
 else
 	rm bin/*
 fi
-g++ -g -O0 -I . -o bin/interrupts interrupts.cpp
\ No newline at end of file
+g++ -g -O0 -I . -o bin/interrupts interrupts.cpp -pthread
+g++ -g -O2 -I . -o bin/benchmarks benchmarks.cpp
+g++ -g -O2 -I . -o bin/decode_execution decode_execution.cpp
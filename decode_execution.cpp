@@ -0,0 +1,106 @@
+/**
+ * @file decode_execution.cpp
+ *
+ * Turns a binary execution log (interrupts --binary) back into the
+ * execution.txt text format.
+ *
+ * To run it, do: ./decode_execution <execution.bin> [output.txt]
+ */
+
+#include <output.hpp>
+
+//Reads one length-prefixed string of the string table, at most remaining bytes long in all
+bool read_string(std::ifstream& input, std::string& text, uint64_t& remaining) {
+    uint32_t length;
+    if (remaining < sizeof(length) || !input.read((char*)&length, sizeof(length))) {
+        return false;
+    }
+    remaining -= sizeof(length);
+    if (length > remaining) {
+        return false;
+    }
+    remaining -= length;
+    text.resize(length);
+    return (bool)input.read(text.data(), length);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2 && argc != 3) {
+        std::cout << "To run the program, do: ./decode_execution <execution.bin> [output.txt]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream input(argv[1], std::ios::binary | std::ios::ate);
+    if (!input.is_open()) {
+        std::cerr << "Error: Unable to open file: " << argv[1] << std::endl;
+        return 1;
+    }
+    uint64_t remaining = (uint64_t)input.tellg();
+    input.seekg(0);
+
+    // Header: magic and string table
+    const size_t version = sizeof(binary_log_magic) - 1;
+    char magic[sizeof(binary_log_magic)];
+    uint32_t vector_count;
+    if (!input.read(magic, sizeof(magic)) || memcmp(magic, binary_log_magic, version) != 0) {
+        std::cerr << "Error: " << argv[1] << " is not a binary execution log" << std::endl;
+        return 1;
+    }
+    if (magic[version] != binary_log_magic[version]) {
+        std::cerr << "Error: " << argv[1] << " is a version " << magic[version]
+                  << " binary execution log, this decoder reads version " << binary_log_magic[version] << std::endl;
+        return 1;
+    }
+    if (!input.read((char*)&vector_count, sizeof(vector_count))) {
+        std::cerr << "Error: truncated string table in " << argv[1] << std::endl;
+        return 1;
+    }
+    remaining -= sizeof(magic) + sizeof(vector_count);
+
+    // Every string takes at least its length prefix, twice per vector
+    if (vector_count > remaining / (2 * sizeof(uint32_t))) {
+        std::cerr << "Error: string table of " << argv[1] << " claims " << vector_count
+                  << " vectors, more than the file holds" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> vectors(vector_count);
+    std::vector<std::string> positions(vector_count);
+    bool header_ok = true;
+    for (auto& vector : vectors) {
+        header_ok = header_ok && read_string(input, vector, remaining);
+    }
+    for (auto& position : positions) {
+        header_ok = header_ok && read_string(input, position, remaining);
+    }
+    if (!header_ok) {
+        std::cerr << "Error: truncated string table in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    // Records
+    output_sink output(argc == 3 ? argv[2] : "execution.txt");
+    binary_record entry;
+    while (input.read((char*)&entry, sizeof(entry))) {
+        if (entry.event >= (uint16_t)log_event::EVENT_COUNT) {
+            std::cerr << "Error: unknown event code " << entry.event << std::endl;
+            return 1;
+        }
+        if ((entry.event == (uint16_t)log_event::FIND_VECTOR || entry.event == (uint16_t)log_event::LOAD_ADDRESS)
+            && entry.operand >= vector_count) {
+            std::cerr << "Error: vector " << entry.operand << " is not in the string table of "
+                      << vector_count << " vectors" << std::endl;
+            return 1;
+        }
+
+        write_event_text(output, entry.time, entry.duration, (log_event)entry.event, entry.operand,
+                         vectors, positions);
+    }
+    if (input.gcount() != 0) {
+        std::cerr << "Error: truncated record at the end of " << argv[1] << std::endl;
+        return 1;
+    }
+
+    output.close();
+    return 0;
+}
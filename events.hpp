@@ -0,0 +1,72 @@
+/**
+ * @file events.hpp
+ *
+ * Event calendar of the discrete-event engine: pending events kept in a binary
+ * heap ordered by the time they fire, so asynchronous work such as device I/O
+ * can complete while other processes use the CPU.
+ */
+
+#ifndef EVENTS_HPP_
+#define EVENTS_HPP_
+
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+//Kinds of events the calendar holds
+enum class event_type : unsigned char {
+    IO_COMPLETE     //a device finished the I/O a process is blocked on
+};
+
+//One pending event
+struct sim_event {
+    int         time;       //when it fires
+    int         process;    //process the event concerns
+    int         device;     //device (interrupt vector) of I/O events
+    event_type  type;
+    uint64_t    order;      //scheduling order: events due at the same time fire first in, first out
+
+    bool operator>(const sim_event& other) const {
+        return time != other.time ? time > other.time : order > other.order;
+    }
+};
+
+/**
+ * \brief pending events in firing order
+ *
+ * Scheduling and firing an event are O(log n) in the number of pending
+ * events.
+ *
+ */
+class event_calendar {
+public:
+    void schedule(int time, event_type type, int process, int device) {
+        pending.push({time, process, device, type, order++});
+    }
+
+    bool empty() const {
+        return pending.empty();
+    }
+
+    size_t size() const {
+        return pending.size();
+    }
+
+    //Time of the earliest pending event; the calendar must not be empty
+    int next_time() const {
+        return pending.top().time;
+    }
+
+    //Removes and returns the earliest pending event
+    sim_event pop() {
+        sim_event event = pending.top();
+        pending.pop();
+        return event;
+    }
+
+private:
+    std::priority_queue<sim_event, std::vector<sim_event>, std::greater<sim_event>> pending;
+    uint64_t                                                                        order = 0;
+};
+
+#endif
@@ -0,0 +1,130 @@
+/**
+ * @file input.hpp
+ *
+ * Input side of the simulator: memory-mapped input files and helpers that
+ * tokenize their lines in place, without copying them into strings.
+ */
+
+#ifndef INPUT_HPP_
+#define INPUT_HPP_
+
+#include<string>
+#include<string_view>
+#include<charconv>
+#include<ctype.h>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+/**
+ * \brief read-only memory mapping of a whole file
+ *
+ * The file contents are exposed as a string_view over the mapping, so lines can
+ * be tokenized where they are instead of being read into strings first.
+ *
+ */
+class mapped_file {
+public:
+    mapped_file(const std::string& filename): data(nullptr), length(0), opened(false) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if(fd < 0) {
+            return;
+        }
+
+        struct stat info;
+        if(fstat(fd, &info) == 0) {
+            opened = true;
+            length = info.st_size;
+            if(length > 0) {
+                void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(mapping == MAP_FAILED) {
+                    opened = false;
+                    length = 0;
+                } else {
+                    data = (const char*)mapping;
+                    madvise(mapping, length, MADV_SEQUENTIAL);
+                }
+            }
+        }
+        ::close(fd);
+    }
+
+    ~mapped_file() {
+        if(data) {
+            munmap((void*)data, length);
+        }
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool is_open() const {
+        return opened;
+    }
+
+    std::string_view contents() const {
+        return std::string_view(data, length);
+    }
+
+private:
+    const char* data;
+    size_t      length;
+    bool        opened;
+};
+
+//Walks the lines of a text the way std::getline does: no trailing empty line, '\n' stripped
+class line_reader {
+public:
+    line_reader(std::string_view text): text(text) {}
+
+    bool next(std::string_view& line) {
+        if(text.empty()) {
+            return false;
+        }
+
+        size_t end = text.find('\n');
+        if(end == std::string_view::npos) {
+            line = text;
+            text = std::string_view();
+        } else {
+            line = text.substr(0, end);
+            text.remove_prefix(end + 1);
+        }
+        return true;
+    }
+
+private:
+    std::string_view text;
+};
+
+//Returns the token before the first delim and drops it (and the delim) from the input
+std::string_view next_token(std::string_view& input, char delim) {
+    size_t pos = input.find(delim);
+    std::string_view token = input.substr(0, pos);
+    input.remove_prefix(pos == std::string_view::npos ? input.size() : pos + 1);
+    return token;
+}
+
+//Parses a leading integer like std::stoi, but returns false instead of throwing
+bool parse_int(std::string_view text, int& value) {
+    size_t start = 0;
+    while(start < text.size() && isspace((unsigned char)text[start])) {
+        start++;
+    }
+    if(start < text.size() && text[start] == '+') {
+        start++;
+    }
+
+    auto result = std::from_chars(text.data() + start, text.data() + text.size(), value);
+    return result.ec == std::errc();
+}
+
+//Parses text that must be exactly one integer of type T, for command line values where trailing text is a mistake
+template<typename T>
+bool parse_whole_int(std::string_view text, T& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+#endif
@@ -7,32 +7,24 @@
 #include<vector>
 #include<random>
 #include<utility>
+#include<tuple>
+#include<unordered_map>
+#include<optional>
+#include<memory>
+#include<cstdint>
 #include<sstream>
 #include<iomanip>
 #include <algorithm>
 #include<stdio.h>
+#include<string.h>
+
+#include<input.hpp>
+#include<memory.hpp>
+#include<output.hpp>
 
 #define ADDR_BASE   0
 #define VECTOR_SIZE 2
 
-struct memory_partition_t {
-    const unsigned int partition_number;
-    const unsigned int size;
-    std::string code;
-
-    memory_partition_t(unsigned int _pn, unsigned int _s, std::string _c):
-        partition_number(_pn), size(_s), code(_c) {}
-};
-
-memory_partition_t memory[] = {
-    memory_partition_t(1, 40, "empty"),
-    memory_partition_t(2, 25, "empty"),
-    memory_partition_t(3, 15, "empty"),
-    memory_partition_t(4, 10, "empty"),
-    memory_partition_t(5, 8, "empty"),
-    memory_partition_t(6, 2, "empty")
-};
-
 struct PCB{
     unsigned int    PID;
     int             PPID;
@@ -47,41 +39,514 @@ struct PCB{
 struct external_file{
     std::string     program_name;
     unsigned int    size;
+    int             priority = 0;   //optional third column; lower runs first under --scheduler priority
+};
+
+//Interns program names so EXEC instructions only carry a small integer id
+struct program_table {
+    std::vector<std::string>                names;
+    std::unordered_map<std::string, int>    ids;
+
+    int intern(std::string_view program_name) {
+        std::string name(program_name);
+        auto found = ids.find(name);
+        if(found != ids.end()) {
+            return found->second;
+        }
+        int id = names.size();
+        names.push_back(name);
+        ids.emplace(name, id);
+        return id;
+    }
+};
+
+/**
+ * \brief external files table, indexed by interned program id
+ *
+ * Built once while parsing the external files. Every listed program is interned
+ * first, so looking up a program's size is an array access by program id.
+ * 
+ */
+struct program_registry {
+    program_table               programs;   //the listed programs, then whatever traces EXEC
+    std::vector<external_file>  files;      //as listed, for printing
+    std::vector<unsigned int>   sizes;      //by program id, for the listed programs
+    std::vector<int>            priorities; //by program id, for the listed programs
+
+    void add(const external_file& file) {
+        files.push_back(file);
+        int id = programs.intern(file.program_name);
+        if((size_t)id == sizes.size()) {
+            sizes.push_back(file.size); //the first entry of a name wins
+            priorities.push_back(file.priority);
+        }
+    }
+
+    //Size of a program, or nothing if it is not in the external files table
+    std::optional<unsigned int> size_of(int program) const {
+        if(program >= 0 && (size_t)program < sizes.size()) {
+            return sizes[program];
+        }
+        return std::nullopt;
+    }
+
+    //Scheduling priority of a program; 0 if it is not in the external files table
+    int priority_of(int program) const {
+        if(program >= 0 && (size_t)program < priorities.size()) {
+            return priorities[program];
+        }
+        return 0;
+    }
+};
+
+
+/**
+ * \brief random number generator of one simulation (PCG32)
+ *
+ * 16 bytes of state and no locking, unlike rand(). The seed goes through
+ * splitmix64 first, so nearby seeds (like a batch's seed + i) give unrelated
+ * sequences.
+ *
+ */
+class sim_random {
+public:
+    sim_random() {
+        seed(0);
+    }
+
+    void seed(uint64_t value) {
+        value += 0x9E3779B97F4A7C15ull; // splitmix64
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        value ^= value >> 31;
+
+        state = 0;
+        increment = (value << 1) | 1;
+        next();
+        state += value;
+        next();
+    }
+
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ull + increment;
+        uint32_t shifted = ((old >> 18) ^ old) >> 27;
+        uint32_t rotation = old >> 59;
+        return (shifted >> rotation) | (shifted << ((-rotation) & 31));
+    }
+
+private:
+    uint64_t    state;
+    uint64_t    increment;  //odd: selects the sequence
+};
+
+/**
+ * \brief mutable state of one simulation
+ *
+ * Every simulation owns one, and nothing else it touches is global, so
+ * simulations can run side by side on any number of threads.
+ *
+ */
+struct sim_state {
+    //Main memory: fixed partitions unless the options pick another model
+    std::unique_ptr<memory_manager> memory = std::make_unique<partition_table>(default_partition_sizes);
+    latency_stats                   allocation_latency; //how long each allocate_memory call took, for the report
+    int                             next_pid = 1;       //PID of the next FORKed child
+    sim_random                      random;             //random delays
 };
 
 //Allocates a program to memory (if there is space)
 //returns true if the allocation was sucessful, false if not.
-bool allocate_memory(PCB* current) {
-    for(int i = 5; i >= 0; i--) { //Start from smallest partition
-        //check is the code will fit and if the partition is empty
-        if(memory[i].size >= current->size && memory[i].code == "empty") {
-            current->partition_number = memory[i].partition_number;
-            memory[i].code = current->program_name;
-            return true;
-        }
+bool allocate_memory(sim_state& state, PCB* current) {
+    auto start = std::chrono::steady_clock::now();
+    int partition_number = state.memory->allocate(current->size, current->program_name);
+    state.allocation_latency.add(std::chrono::steady_clock::now() - start);
+
+    if(partition_number < 0) {
+        return false;
     }
-    return false;
+    current->partition_number = partition_number;
+    return true;
 }
 
 //frees the memory given PCB.
-void free_memory(PCB* process) {
-    memory[process->partition_number - 1].code = "empty";
+void free_memory(sim_state& state, PCB* process) {
+    if(process->partition_number >= 0) { //-1: its allocation failed, nothing to free
+        state.memory->release(process->partition_number);
+    }
     process->partition_number = -1;
 }
 
-// Following function was taken from stackoverflow; helper function for splitting strings
-std::vector<std::string> split_delim(std::string input, std::string delim) {
-    std::vector<std::string> tokens;
-    std::size_t pos = 0;
-    std::string token;
-    while ((pos = input.find(delim)) != std::string::npos) {
-        token = input.substr(0, pos);
-        tokens.push_back(token);
-        input.erase(0, pos + delim.length());
+//Relocates resident programs so that a program of size Mb fits; returns the Mb relocated (0 if it cannot help)
+unsigned int compact_memory(sim_state& state, unsigned int size) {
+    return state.memory->compact(size);
+}
+
+//Memory models selectable with --memory
+enum class memory_model {
+    FIXED,      //fixed partitions, best fit
+    VARIABLE,   //contiguous variable partitions
+    BUDDY,      //binary buddy allocator
+    PAGED       //demand paging with a TLB
+};
+
+//Waiting processes swapped out first under memory pressure
+enum class swap_policy {
+    OLDEST,     //waiting the longest; it resumes last
+    NEWEST,     //started waiting most recently; it resumes first
+    LARGEST     //holding the most memory
+};
+
+//How a FORKed child gets its memory
+enum class fork_memory {
+    SHARED,     //legacy: the child uses the parent's partition, and its exit frees it
+    EAGER,      //the child gets a copy of the parent's memory at FORK
+    COW         //the child shares the parent's memory, reference counted, until its first write
+};
+
+//Scheduling policies of --scheduler
+enum class scheduling_policy {
+    NONE,       //legacy: a FORKed child runs to completion while its parent waits
+    FCFS,       //first come, first served
+    RR,         //round robin with a quantum
+    PRIORITY,   //preemptive, by program priority
+    SJF,        //shortest next CPU burst, non-preemptive
+    SRTF,       //shortest remaining CPU burst, preemptive
+    MLFQ        //multilevel feedback queue
+};
+
+//Optional simulator settings, given after the four input files
+struct sim_options {
+    bool                binary_output = false;          //--binary: write the compact execution.bin instead of execution.txt
+    std::string         partition_file;                 //--partitions <file>: one partition size (Mb) per line
+    std::vector<unsigned int> partitions = default_partition_sizes; //partition sizes, loaded from the partition file
+    memory_model        model = memory_model::FIXED;    //--memory fixed|variable|buddy|paged
+    unsigned int        memory_size = 0;                //--memory-size <Mb>: total memory of the variable and buddy models, 0 for their default
+    fit_policy          fit = fit_policy::BEST;         //--fit first|best|worst|next: hole the variable model picks
+    unsigned int        frames = 16;                    //--frames <n>: page frames of the paged model
+    unsigned int        page_size = 1;                  //--page-size <Mb>
+    unsigned int        tlb_size = 8;                   //--tlb-size <n>: TLB entries, 0 for no TLB
+    replacement_policy  replacement = replacement_policy::CLOCK; //--replacement fifo|clock|lfu
+    int                 fault_vector = 14;              //--fault-vector <n>: interrupt vector of page faults
+    int                 touch_interval = 5;             //--touch-interval <ms>: CPU time between page references
+    bool                compaction = false;             //--compaction: compact memory and retry when an EXEC does not fit
+    int                 relocation_rate = 2;            //--relocation-rate <ms>: compaction time per Mb relocated
+    bool                swapping = false;               //--swap oldest|newest|largest: swap waiting processes out when an EXEC does not fit
+    swap_policy         swap_victim = swap_policy::OLDEST;
+    int                 swap_rate = 5;                  //--swap-rate <ms>: swap transfer time per Mb
+    int                 swap_vector = 15;               //--swap-vector <n>: interrupt vector of swap-in completions
+    fork_memory         fork_mode = fork_memory::SHARED;//--fork-memory shared|eager|cow
+    int                 cow_write_burst = 0;            //--cow-write-burst <ms>: CPU bursts this long write memory, 0 for never
+    int                 copy_rate = 2;                  //--copy-rate <ms>: time per Mb copied for a FORKed child
+    scheduling_policy   scheduler = scheduling_policy::NONE;//--scheduler fcfs|rr|priority|sjf|srtf|mlfq: run processes concurrently
+    int                 quantum = 50;                   //--quantum <ms>: round robin quantum, and the top MLFQ level's
+    int                 timer_vector = 0;               //--timer-vector <n>: interrupt vector of context switches
+    bool                async_io = false;               //--async-io: SYSCALL device I/O overlaps other processes' CPU bursts
+    bool                batch = false;                  //--batch: the first argument is a manifest of trace files
+    int                 jobs = 0;                       //--jobs <n>: batch and replication worker threads, 0 for one per core
+    int                 replications = 0;               //--replications <n>: Monte Carlo runs of the trace, 0 for a single run
+    int                 context_save_time = 10;         //--context-save <ms>: time every interrupt takes to save the context
+    int                 load_rate = 15;                 //--load-rate <ms>: EXEC load time per Mb
+    std::vector<int>    sweep_context_save;             //--sweep-context-save <list>: context save times to sweep
+    std::vector<int>    sweep_load_rate;                //--sweep-load-rate <list>: load rates to sweep
+    std::string         sweep_output = "sweep.csv";     //--sweep-output <file>: CSV the sweep writes
+    std::string         output_dir = "batch_output";    //--output-dir <dir>: where batch runs write their outputs
+    std::optional<unsigned int> seed;                   //--seed <n>: seed of the random delays; time based if not given
+};
+
+//Returns the value following option i and moves past it; exits if there is none
+const char* option_value(int argc, char** argv, int& i) {
+    if(i + 1 >= argc) {
+        std::cerr << "Error: Missing value for option: " << argv[i] << std::endl;
+        exit(1);
     }
-    tokens.push_back(input);
+    return argv[++i];
+}
 
-    return tokens;
+//Returns the integer value following option i and moves past it; exits if it is missing or below min
+int int_option_value(int argc, char** argv, int& i, int min) {
+    const char* option = argv[i];
+    const char* value = option_value(argc, argv, i);
+    int number;
+    if(!parse_whole_int(value, number) || number < min) {
+        std::cerr << "Error: Invalid value for " << option << ": " << value << std::endl;
+        exit(1);
+    }
+    return number;
+}
+
+//Most points a sweep runs, over the whole context save by load rate grid
+const size_t max_sweep_points = 10000;
+
+//Returns the integer list following option i, like 5,10,20 or the inclusive range 5:30:5 (start:end:step),
+//and moves past it; exits if it is malformed, has a value below min or more than max_sweep_points values
+std::vector<int> int_list_value(int argc, char** argv, int& i, int min) {
+    const char* option = argv[i];
+    const char* value = option_value(argc, argv, i);
+    std::vector<int> numbers;
+    bool valid = true;
+
+    std::string_view list = value;
+    while(valid && !list.empty()) {
+        std::string_view range = next_token(list, ',');
+        bool stepped = range.find(':') != std::string_view::npos;
+        int start, end, step = 1;
+        valid = parse_whole_int(next_token(range, ':'), start);
+        end = start;
+        if(valid && stepped) {
+            valid = parse_whole_int(next_token(range, ':'), end) && (range.empty() || parse_whole_int(range, step))
+                    && step > 0;
+        }
+        if(valid && start <= end && ((long)end - start) / step >= (long)(max_sweep_points - numbers.size())) {
+            std::cerr << "Error: " << option << " lists more than " << max_sweep_points << " values" << std::endl;
+            exit(1);
+        }
+        for(long number = start; valid && number <= end; number += step) {
+            valid = number >= min;
+            numbers.push_back(number);
+        }
+    }
+
+    if(!valid || numbers.empty()) {
+        std::cerr << "Error: Invalid value list for " << option << ": " << value << std::endl;
+        exit(1);
+    }
+    return numbers;
+}
+
+//Parses the options following the four input files; exits on anything unknown
+sim_options parse_options(int argc, char** argv) {
+    sim_options options;
+
+    for(int i = 5; i < argc; i++) {
+        std::string option = argv[i];
+
+        if(option == "--binary") {
+            options.binary_output = true;
+        } else if(option == "--partitions") {
+            options.partition_file = option_value(argc, argv, i);
+        } else if(option == "--memory") {
+            std::string mode = option_value(argc, argv, i);
+            if(mode == "fixed") {
+                options.model = memory_model::FIXED;
+            } else if(mode == "variable") {
+                options.model = memory_model::VARIABLE;
+            } else if(mode == "buddy") {
+                options.model = memory_model::BUDDY;
+            } else if(mode == "paged") {
+                options.model = memory_model::PAGED;
+            } else {
+                std::cerr << "Error: Unknown memory mode: " << mode << std::endl;
+                exit(1);
+            }
+        } else if(option == "--memory-size") {
+            options.memory_size = int_option_value(argc, argv, i, 1);
+        } else if(option == "--fit") {
+            std::string policy = option_value(argc, argv, i);
+            if(policy == "first") {
+                options.fit = fit_policy::FIRST;
+            } else if(policy == "best") {
+                options.fit = fit_policy::BEST;
+            } else if(policy == "worst") {
+                options.fit = fit_policy::WORST;
+            } else if(policy == "next") {
+                options.fit = fit_policy::NEXT;
+            } else {
+                std::cerr << "Error: Unknown fit policy: " << policy << std::endl;
+                exit(1);
+            }
+        } else if(option == "--frames") {
+            options.frames = int_option_value(argc, argv, i, 1);
+        } else if(option == "--page-size") {
+            options.page_size = int_option_value(argc, argv, i, 1);
+        } else if(option == "--tlb-size") {
+            options.tlb_size = int_option_value(argc, argv, i, 0);
+        } else if(option == "--replacement") {
+            std::string policy = option_value(argc, argv, i);
+            if(policy == "fifo") {
+                options.replacement = replacement_policy::FIFO;
+            } else if(policy == "clock") {
+                options.replacement = replacement_policy::CLOCK;
+            } else if(policy == "lfu") {
+                options.replacement = replacement_policy::LFU;
+            } else {
+                std::cerr << "Error: Unknown replacement policy: " << policy << std::endl;
+                exit(1);
+            }
+        } else if(option == "--fault-vector") {
+            options.fault_vector = int_option_value(argc, argv, i, 0);
+        } else if(option == "--touch-interval") {
+            options.touch_interval = int_option_value(argc, argv, i, 1);
+        } else if(option == "--compaction") {
+            options.compaction = true;
+        } else if(option == "--relocation-rate") {
+            options.relocation_rate = int_option_value(argc, argv, i, 0);
+        } else if(option == "--swap") {
+            std::string policy = option_value(argc, argv, i);
+            options.swapping = true;
+            if(policy == "oldest") {
+                options.swap_victim = swap_policy::OLDEST;
+            } else if(policy == "newest") {
+                options.swap_victim = swap_policy::NEWEST;
+            } else if(policy == "largest") {
+                options.swap_victim = swap_policy::LARGEST;
+            } else {
+                std::cerr << "Error: Unknown swap policy: " << policy << std::endl;
+                exit(1);
+            }
+        } else if(option == "--swap-rate") {
+            options.swap_rate = int_option_value(argc, argv, i, 0);
+        } else if(option == "--swap-vector") {
+            options.swap_vector = int_option_value(argc, argv, i, 0);
+        } else if(option == "--fork-memory") {
+            std::string mode = option_value(argc, argv, i);
+            if(mode == "shared") {
+                options.fork_mode = fork_memory::SHARED;
+            } else if(mode == "eager") {
+                options.fork_mode = fork_memory::EAGER;
+            } else if(mode == "cow") {
+                options.fork_mode = fork_memory::COW;
+            } else {
+                std::cerr << "Error: Unknown fork memory mode: " << mode << std::endl;
+                exit(1);
+            }
+        } else if(option == "--cow-write-burst") {
+            options.cow_write_burst = int_option_value(argc, argv, i, 0);
+        } else if(option == "--copy-rate") {
+            options.copy_rate = int_option_value(argc, argv, i, 0);
+        } else if(option == "--scheduler") {
+            std::string policy = option_value(argc, argv, i);
+            if(policy == "fcfs") {
+                options.scheduler = scheduling_policy::FCFS;
+            } else if(policy == "rr") {
+                options.scheduler = scheduling_policy::RR;
+            } else if(policy == "priority") {
+                options.scheduler = scheduling_policy::PRIORITY;
+            } else if(policy == "sjf") {
+                options.scheduler = scheduling_policy::SJF;
+            } else if(policy == "srtf") {
+                options.scheduler = scheduling_policy::SRTF;
+            } else if(policy == "mlfq") {
+                options.scheduler = scheduling_policy::MLFQ;
+            } else {
+                std::cerr << "Error: Unknown scheduling policy: " << policy << std::endl;
+                exit(1);
+            }
+        } else if(option == "--quantum") {
+            options.quantum = int_option_value(argc, argv, i, 1);
+        } else if(option == "--timer-vector") {
+            options.timer_vector = int_option_value(argc, argv, i, 0);
+        } else if(option == "--async-io") {
+            options.async_io = true;
+        } else if(option == "--batch") {
+            options.batch = true;
+        } else if(option == "--jobs") {
+            options.jobs = int_option_value(argc, argv, i, 1);
+        } else if(option == "--replications") {
+            options.replications = int_option_value(argc, argv, i, 1);
+        } else if(option == "--context-save") {
+            options.context_save_time = int_option_value(argc, argv, i, 0);
+        } else if(option == "--load-rate") {
+            options.load_rate = int_option_value(argc, argv, i, 0);
+        } else if(option == "--sweep-context-save") {
+            options.sweep_context_save = int_list_value(argc, argv, i, 0);
+        } else if(option == "--sweep-load-rate") {
+            options.sweep_load_rate = int_list_value(argc, argv, i, 0);
+        } else if(option == "--sweep-output") {
+            options.sweep_output = option_value(argc, argv, i);
+        } else if(option == "--output-dir") {
+            options.output_dir = option_value(argc, argv, i);
+        } else if(option == "--seed") {
+            const char* value = option_value(argc, argv, i);
+            unsigned int seed;
+            if(!parse_whole_int(value, seed)) { //any unsigned int, like the seeds runs report
+                std::cerr << "Error: Invalid value for " << option << ": " << value << std::endl;
+                exit(1);
+            }
+            options.seed = seed;
+        } else {
+            std::cerr << "Error: Unknown option: " << option << std::endl;
+            exit(1);
+        }
+    }
+
+    if(options.model != memory_model::FIXED && !options.partition_file.empty()) {
+        std::cerr << "Error: --partitions only applies to --memory fixed" << std::endl;
+        exit(1);
+    }
+    if(options.scheduler != scheduling_policy::NONE && options.swapping) {
+        std::cerr << "Error: --swap only applies without --scheduler" << std::endl;
+        exit(1);
+    }
+    bool sweep = !options.sweep_context_save.empty() || !options.sweep_load_rate.empty();
+    if(std::max<size_t>(options.sweep_context_save.size(), 1) * std::max<size_t>(options.sweep_load_rate.size(), 1)
+       > max_sweep_points) {
+        std::cerr << "Error: the sweep grid has more than " << max_sweep_points << " points" << std::endl;
+        exit(1);
+    }
+    if(!options.batch && !options.replications && !sweep && options.jobs) {
+        std::cerr << "Error: --jobs only applies with --batch, --replications or a sweep" << std::endl;
+        exit(1);
+    }
+    if(options.batch && options.replications) {
+        std::cerr << "Error: --replications does not apply with --batch" << std::endl;
+        exit(1);
+    }
+    if(sweep && (options.batch || options.replications)) {
+        std::cerr << "Error: a sweep does not apply with --batch or --replications" << std::endl;
+        exit(1);
+    }
+    if(options.scheduler == scheduling_policy::NONE && options.async_io) {
+        std::cerr << "Error: --async-io only applies with --scheduler" << std::endl;
+        exit(1);
+    }
+    if(options.model != memory_model::VARIABLE && options.compaction) {
+        std::cerr << "Error: --compaction only applies to --memory variable" << std::endl;
+        exit(1);
+    }
+
+    return options;
+}
+
+//Reads a partition layout: one partition size (Mb) per line, numbered from 1
+std::vector<unsigned int> load_partition_file(const std::string& filename) {
+    mapped_file partition_file(filename);
+    if (!partition_file.is_open()) {
+        std::cerr << "Error: Unable to open file: " << filename << std::endl;
+        exit(1);
+    }
+
+    std::vector<unsigned int> sizes;
+    std::string_view line;
+    line_reader lines(partition_file.contents());
+    while(lines.next(line)) {
+        int size;
+        if(!parse_int(line, size) || size <= 0) {
+            std::cerr << "Error: Malformed partition size: " << line << std::endl;
+            exit(1);
+        }
+        sizes.push_back(size);
+    }
+
+    if(sizes.empty()) {
+        std::cerr << "Error: No partitions in " << filename << std::endl;
+        exit(1);
+    }
+    return sizes;
+}
+
+//Builds an empty main memory of the model the options pick
+std::unique_ptr<memory_manager> make_memory(const sim_options& options) {
+    switch(options.model) {
+    case memory_model::VARIABLE:
+        return std::make_unique<variable_memory>(options.memory_size ? options.memory_size : 100, options.fit);
+    case memory_model::BUDDY:
+        return std::make_unique<buddy_memory>(options.memory_size ? options.memory_size : 128);
+    case memory_model::PAGED:
+        return std::make_unique<paged_memory>(options.frames, options.page_size, options.tlb_size, options.replacement);
+    default:
+        return std::make_unique<partition_table>(options.partitions);
+    }
 }
 
 /**
@@ -91,16 +556,28 @@ std::vector<std::string> split_delim(std::string input, std::string delim) {
  * 
  * @param argc number of command line arguments
  * @param argv the command line arguments
- * @return a vector of strings (the parsed vector table), a vector of delays, a vector of external files
+ * @return a vector of strings (the parsed vector table), a vector of delays, the external files registry,
+ *         and the simulator options
  * 
  */
-std::tuple<std::vector<std::string>, std::vector<int>, std::vector<external_file>>parse_args(int argc, char** argv) {
-    if(argc != 5) {
+std::tuple<std::vector<std::string>, std::vector<int>, program_registry, sim_options>parse_args(int argc, char** argv) {
+    if(argc < 5) {
         std::cout << "ERROR!\nExpected 4 argument, received " << argc - 1 << std::endl;
-        std::cout << "To run the program, do: ./interrutps <your_trace_file.txt> <your_vector_table.txt> <your_device_table.txt> <your_external_files.txt>" << std::endl;
+        std::cout << "To run the program, do: ./interrutps <your_trace_file.txt> <your_vector_table.txt> <your_device_table.txt> <your_external_files.txt> [--binary] [--partitions <your_partitions.txt>] [--memory fixed|variable|buddy|paged] [--memory-size <Mb>] [--fit first|best|worst|next] [--frames <n>] [--page-size <Mb>] [--tlb-size <n>] [--replacement fifo|clock|lfu] [--fault-vector <n>] [--touch-interval <ms>] [--compaction] [--relocation-rate <ms>] [--swap oldest|newest|largest] [--swap-rate <ms>] [--swap-vector <n>] [--fork-memory shared|eager|cow] [--cow-write-burst <ms>] [--copy-rate <ms>] [--scheduler fcfs|rr|priority|sjf|srtf|mlfq] [--quantum <ms>] [--timer-vector <n>] [--async-io] [--batch] [--jobs <n>] [--output-dir <dir>] [--seed <n>] [--replications <n>] [--context-save <ms>] [--load-rate <ms>] [--sweep-context-save <list>] [--sweep-load-rate <list>] [--sweep-output <file>]" << std::endl;
         exit(1);
     }
 
+    sim_options options = parse_options(argc, argv);
+    if(options.model == memory_model::BUDDY) {
+        unsigned int size = options.memory_size ? options.memory_size : 128;
+        if(size & (size - 1)) {
+            std::cerr << "Error: Buddy memory size must be a power of two: " << size << std::endl;
+            exit(1);
+        }
+    } else if(options.model == memory_model::FIXED && !options.partition_file.empty()) {
+        options.partitions = load_partition_file(options.partition_file);
+    }
+
     std::ifstream input_file;
     input_file.open(argv[1]);
     if (!input_file.is_open()) {
@@ -109,120 +586,287 @@ std::tuple<std::vector<std::string>, std::vector<int>, std::vector<external_file
     }
     input_file.close();
 
-    input_file.open(argv[2]);
-    if (!input_file.is_open()) {
+    mapped_file vector_file(argv[2]);
+    if (!vector_file.is_open()) {
         std::cerr << "Error: Unable to open file: " << argv[2] << std::endl;
         exit(1);
     }
 
-    std::string vector;
+    std::string_view vector;
     std::vector<std::string> vectors;
-    while(std::getline(input_file, vector)) {
-        vectors.push_back(vector);
+    line_reader vector_lines(vector_file.contents());
+    while(vector_lines.next(vector)) {
+        vectors.emplace_back(vector);
     }
-    input_file.close();
 
-    std::string duration;
+    std::string_view duration;
     std::vector<int> delays;
-    input_file.open(argv[3]);
+    mapped_file device_file(argv[3]);
 
-    if (!input_file.is_open()) {
+    if (!device_file.is_open()) {
         std::cerr << "Error: Unable to open file: " << argv[3] << std::endl;
         exit(1);
     }
 
-    while(std::getline(input_file, duration)) {
-        delays.push_back(std::stoi(duration));
+    line_reader device_lines(device_file.contents());
+    while(device_lines.next(duration)) {
+        int delay;
+        if(!parse_int(duration, delay)) {
+            std::cerr << "Error: Malformed device table line: " << duration << std::endl;
+            exit(1);
+        }
+        delays.push_back(delay);
     }
-    input_file.close();
 
-    std::vector<external_file> external_files;
-    input_file.open(argv[4]);
-    if (!input_file.is_open()) {
+    program_registry external_files;
+    mapped_file external_file_table(argv[4]);
+    if (!external_file_table.is_open()) {
         std::cerr << "Error: Unable to open file: " << argv[4] << std::endl;
         exit(1);
     }
 
-    std::string file_content;
-    while(std::getline(input_file, file_content)) {
+    std::string_view file_content;
+    line_reader external_lines(external_file_table.contents());
+    while(external_lines.next(file_content)) {
         external_file entry;
-        auto file_info      = split_delim(file_content, ",");
+        std::string_view file_info = file_content;
+        std::string_view name = next_token(file_info, ',');
+        int size;
+
+        if(!parse_int(next_token(file_info, ','), size)) {
+            std::cerr << "Error: Malformed external file line: " << file_content << std::endl;
+            exit(1);
+        }
+        std::string_view priority = next_token(file_info, ',');
+        if(!priority.empty() && !parse_int(priority, entry.priority)) {
+            std::cerr << "Error: Malformed external file line: " << file_content << std::endl;
+            exit(1);
+        }
 
-        entry.program_name  = file_info[0];
-        entry.size          = std::stoi(file_info[1]);
-        external_files.push_back(entry);
+        entry.program_name  = name;
+        entry.size          = size;
+        external_files.add(entry);
     }
 
-    input_file.close();
+    if(options.model == memory_model::PAGED
+       && ((size_t)options.fault_vector >= vectors.size() || (size_t)options.fault_vector >= delays.size())) {
+        std::cerr << "Error: Page fault vector " << options.fault_vector << " is not in the vector and device tables" << std::endl;
+        exit(1);
+    }
+    if(options.scheduler != scheduling_policy::NONE && (size_t)options.timer_vector >= vectors.size()) {
+        std::cerr << "Error: Timer vector " << options.timer_vector << " is not in the vector table" << std::endl;
+        exit(1);
+    }
+    if(options.swapping && (size_t)options.swap_vector >= vectors.size()) {
+        std::cerr << "Error: Swap vector " << options.swap_vector << " is not in the vector table" << std::endl;
+        exit(1);
+    }
 
+    return {vectors, delays, external_files, options};
+}
 
-    return {vectors, delays, external_files};
+//Interrupts a trace can use: those in both the vector and the device table
+size_t interrupt_count(const std::vector<std::string>& vectors, const std::vector<int>& delays) {
+    return std::min(vectors.size(), delays.size());
 }
 
-//Parces each trace and returns a tuple: {Tace activity, duration or interrupt number, program name (if applicable)}
-std::tuple<std::string, int, std::string> parse_trace(std::string trace) {
+//Parces each trace in place and returns a tuple: {Tace activity, duration or interrupt number, program name (if applicable)}
+std::tuple<std::string_view, int, std::string_view> parse_trace(std::string_view trace) {
     //split line by ','
-    auto parts = split_delim(trace, ",");
-    if (parts.size() < 2) {
+    std::string_view parts = trace;
+    std::string_view activity = next_token(parts, ',');
+    int duration_intr;
+    if (activity.size() == trace.size() || !parse_int(next_token(parts, ','), duration_intr)) {
         std::cerr << "Error: Malformed input line: " << trace << std::endl;
         return {"null", -1, "null"};
     }
 
-    auto activity = parts[0];
-    auto duration_intr = std::stoi(parts[1]);
-    std::string extern_file = "null";
+    std::string_view extern_file = "null";
 
-    auto exec = split_delim(parts[0], " ");
-    if(exec[0] == "EXEC") {
-        extern_file = exec[1];
+    std::string_view exec = activity;
+    if(next_token(exec, ' ') == "EXEC") {
+        extern_file = next_token(exec, ' ');
         activity = "EXEC";
     }
 
     return {activity, duration_intr, extern_file};
 }
 
-//Default interrupt boilerplate
-std::pair<std::string, int> intr_boilerplate(int current_time, int intr_num, int context_save_time, std::vector<std::string> vectors) {
+//Trace activities, decoded once so the simulator can dispatch on an enum instead of strings
+enum class opcode : unsigned char {
+    CPU,
+    SYSCALL,
+    END_IO,
+    FORK,
+    EXEC,
+    IF_CHILD,
+    IF_PARENT,
+    ENDIF,
+    NOP         //malformed or unknown lines; kept so trace indices stay aligned
+};
 
-    std::string execution = "";
+//One compiled trace line
+struct instruction {
+    opcode  op;
+    int     operand;    //duration or interrupt number
+    int     program;    //interned program id for EXEC, -1 otherwise
+    int     target;     //FORK: index into the fork table, IF_PARENT: where the child continues
+};
 
-    execution += std::to_string(current_time) + ", " + std::to_string(1) + ", switch to kernel mode\n";
-    current_time++;
+//A FORK matched with its IF_CHILD / IF_PARENT / ENDIF markers
+struct fork_block {
+    size_t  child_begin;    //first instruction the child runs
+    size_t  parent_resume;  //first instruction the parent runs once the child is done
+};
 
-    execution += std::to_string(current_time) + ", " + std::to_string(context_save_time) + ", context saved\n";
-    current_time += context_save_time;
-    
-    char vector_address_c[10];
-    sprintf(vector_address_c, "0x%04X", (ADDR_BASE + (intr_num * VECTOR_SIZE)));
-    std::string vector_address(vector_address_c);
+//A compiled trace plus the jump table resolved for its FORKs
+struct compiled_trace {
+    std::vector<instruction>    code;
+    std::vector<fork_block>     forks;
+};
 
-    execution += std::to_string(current_time) + ", " + std::to_string(1) + ", find vector " + std::to_string(intr_num) 
-                    + " in memory position " + vector_address + "\n";
-    current_time++;
+//Maps a trace activity string to its opcode
+opcode decode_activity(std::string_view activity) {
+    if(activity == "CPU")       return opcode::CPU;
+    if(activity == "SYSCALL")   return opcode::SYSCALL;
+    if(activity == "END_IO")    return opcode::END_IO;
+    if(activity == "FORK")      return opcode::FORK;
+    if(activity == "EXEC")      return opcode::EXEC;
+    if(activity == "IF_CHILD")  return opcode::IF_CHILD;
+    if(activity == "IF_PARENT") return opcode::IF_PARENT;
+    if(activity == "ENDIF")     return opcode::ENDIF;
+    return opcode::NOP;
+}
 
-    execution += std::to_string(current_time) + ", " + std::to_string(1) + ", load address " + vectors.at(intr_num) + " into the PC\n";
-    current_time++;
+/**
+ * \brief match FORK blocks like brackets
+ *
+ * Resolves every FORK once so the simulator can jump instead of scanning. The child
+ * runs from IF_CHILD up to IF_PARENT, then jumps past the matching ENDIF; the parent
+ * resumes right after IF_PARENT. Missing markers fall back to the end of the trace;
+ * an IF_PARENT outside any FORK block falls through to the next line.
+ * 
+ * @param trace the compiled trace to fill the jump table of
+ * 
+ */
+void match_fork_blocks(compiled_trace& trace) {
+    std::vector<int> open_forks; //indices into trace.forks
+    size_t end = trace.code.size();
+
+    trace.forks.clear();
+    for(size_t i = 0; i < end; i++) {
+        instruction& ins = trace.code[i];
+
+        switch(ins.op) {
+        case opcode::FORK:
+            ins.target = trace.forks.size();
+            trace.forks.push_back({i + 1, end});
+            open_forks.push_back(ins.target);
+            break;
+        case opcode::IF_CHILD:
+            if(!open_forks.empty()) {
+                trace.forks[open_forks.back()].child_begin = i + 1;
+            }
+            break;
+        case opcode::IF_PARENT:
+            if(open_forks.empty()) {
+                ins.target = i + 1; //outside any FORK block: a marker with nothing to skip
+                break;
+            }
+            ins.target = end;
+            trace.forks[open_forks.back()].parent_resume = i + 1;
+            break;
+        case opcode::ENDIF:
+            if(!open_forks.empty()) {
+                fork_block& block = trace.forks[open_forks.back()];
+                if(block.parent_resume == end) {
+                    block.parent_resume = i + 1; //no IF_PARENT: both continue after ENDIF
+                } else {
+                    trace.code[block.parent_resume - 1].target = i + 1;
+                }
+                open_forks.pop_back();
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
 
-    return std::make_pair(execution, current_time);
+/**
+ * \brief compile a trace into instructions
+ *
+ * Parses every line exactly once, in place, so the simulator never touches strings on the hot path.
+ * 
+ * SYSCALL and END_IO lines whose interrupt is not in the vector and device
+ * tables are reported as malformed and compiled like any other malformed line.
+ * 
+ * @param trace_text the raw trace file contents
+ * @param programs the program name table EXEC targets are interned into
+ * @param interrupts how many interrupts the vector and device tables both have
+ * @return one instruction per trace line, with the FORK jump table resolved
+ * 
+ */
+compiled_trace compile_trace(std::string_view trace_text, program_table& programs, size_t interrupts) {
+    compiled_trace trace;
+    std::vector<instruction>& code = trace.code;
+    code.reserve(std::count(trace_text.begin(), trace_text.end(), '\n') + 1);
+
+    std::string_view line;
+    line_reader lines(trace_text);
+    while(lines.next(line)) {
+        auto [activity, duration_intr, program_name] = parse_trace(line);
+
+        instruction ins{decode_activity(activity), duration_intr, -1, -1};
+        if(ins.op == opcode::EXEC) {
+            ins.program = programs.intern(program_name);
+        }
+        if((ins.op == opcode::SYSCALL || ins.op == opcode::END_IO)
+           && (ins.operand < 0 || (size_t)ins.operand >= interrupts)) {
+            std::cerr << "Error: Malformed input line: " << line << " (interrupt " << ins.operand
+                      << " is not in the vector and device tables)" << std::endl;
+            ins.op = opcode::NOP;
+        }
+        code.push_back(ins);
+    }
+
+    match_fork_blocks(trace);
+    return trace;
 }
 
-//Writes a string to a file
-void write_output(std::string execution, const char* filename) {
-    std::ofstream output_file(filename);
+//Precomputes the "0x%04X" memory position of every interrupt vector, so logging an interrupt never calls sprintf
+std::vector<std::string> vector_positions(size_t count) {
+    std::vector<std::string> positions;
+    char vector_address_c[10];
 
-    if (output_file.is_open()) {
-        output_file << execution;
-        output_file.close();  // Close the file when done
-        std::cout << "File content overwritten successfully." << std::endl;
-    } else {
-        std::cerr << "Error opening file!" << std::endl;
+    for(size_t intr_num = 0; intr_num < count; intr_num++) {
+        snprintf(vector_address_c, sizeof(vector_address_c), "0x%04X", (unsigned int)(ADDR_BASE + (intr_num * VECTOR_SIZE)));
+        positions.push_back(vector_address_c);
     }
 
-    std::cout << "Output generated in execution.txt" << std::endl;
+    return positions;
+}
+
+//Default interrupt boilerplate, recorded in the execution log. Returns the updated time.
+int intr_boilerplate(execution_log& execution, int current_time, int intr_num, int context_save_time) {
+
+    execution.record(current_time, 1, log_event::SWITCH_TO_KERNEL);
+    current_time++;
+
+    execution.record(current_time, context_save_time, log_event::CONTEXT_SAVED);
+    current_time += context_save_time;
+
+    execution.record(current_time, 1, log_event::FIND_VECTOR, intr_num);
+    current_time++;
+
+    execution.record(current_time, 1, log_event::LOAD_ADDRESS, intr_num);
+    current_time++;
+
+    return current_time;
 }
 
 //Helper function for a sanity check. Prints the external files table
-void print_external_files(std::vector<external_file> files) {
+void print_external_files(const std::vector<external_file>& files) {
     const int tableWidth = 24;
 
     std::cout << "List of external files (" << files.size() << " entry(s)): " << std::endl;
@@ -255,7 +899,7 @@ void print_external_files(std::vector<external_file> files) {
 
 //This function takes as input: the current PCB and the waitqueue (which is a
 //std::vector of the PCB struct); the function returns the information as a table
-std::string print_PCB(PCB current, std::vector<PCB> _PCB) {
+std::string print_PCB(const PCB& current, const std::vector<PCB>& _PCB) {
     const int tableWidth = 55;
 
     std::stringstream buffer;
@@ -312,19 +956,4 @@ std::string print_PCB(PCB current, std::vector<PCB> _PCB) {
     return buffer.str();
 }
 
-
-// Searches the external_files table and returns the size of the program
-unsigned int get_size(std::string name, std::vector<external_file> external_files) {
-    int size = -1;
-
-    for (auto file : external_files) { 
-        if(file.program_name == name){
-            size = file.size;
-            break;
-        }
-    }
-
-    return size;
-}
-
 #endif
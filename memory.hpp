@@ -0,0 +1,1049 @@
+/**
+ * @file memory.hpp
+ *
+ * Simulated main memory: the partition table and the structures the
+ * allocators use to find free memory quickly.
+ */
+
+#ifndef MEMORY_HPP_
+#define MEMORY_HPP_
+
+#include<iostream>
+#include<string>
+#include<vector>
+#include<algorithm>
+#include<chrono>
+#include<cstdint>
+#include<list>
+#include<map>
+#include<set>
+#include<unordered_map>
+
+struct memory_partition_t {
+    const unsigned int partition_number;
+    const unsigned int size;
+    std::string code;   //program loaded in the partition, metadata only
+
+    memory_partition_t(unsigned int _pn, unsigned int _s, std::string _c):
+        partition_number(_pn), size(_s), code(_c) {}
+};
+
+//Partition sizes (Mb) used when no partition file is given
+const std::vector<unsigned int> default_partition_sizes = {40, 25, 15, 10, 8, 2};
+
+/**
+ * \brief hierarchical free bitmap
+ *
+ * One bit per slot, plus summary levels where each bit says whether a word of
+ * the level below has any bit set. Finding the next set bit at or after a
+ * position takes one ctz per level, i.e. O(log64 n), with no allocation.
+ *
+ */
+class free_bitmap {
+public:
+    static const size_t npos = (size_t)-1;
+
+    //Resizes to count slots, all set (free) or all clear
+    void reset(size_t count, bool value) {
+        levels.clear();
+        size_t bits = count;
+        do {
+            size_t words = (bits + 63) / 64;
+            std::vector<uint64_t> level(words, value ? ~0ull : 0);
+            if(value && bits % 64) {
+                level.back() = (1ull << (bits % 64)) - 1;
+            }
+            levels.push_back(std::move(level));
+            bits = words;
+        } while(bits > 1);
+    }
+
+    void set(size_t k) {
+        for(auto& level : levels) {
+            uint64_t& word = level[k / 64];
+            bool was_empty = word == 0;
+            word |= 1ull << (k % 64);
+            if(!was_empty) {
+                break;
+            }
+            k /= 64;
+        }
+    }
+
+    void clear(size_t k) {
+        for(auto& level : levels) {
+            uint64_t& word = level[k / 64];
+            word &= ~(1ull << (k % 64));
+            if(word != 0) {
+                break;
+            }
+            k /= 64;
+        }
+    }
+
+    //First set bit at or after k, or npos
+    size_t find_next(size_t k) const {
+        size_t level = 0;
+        size_t pos = k;
+
+        //Climb until some word has a set bit at or after pos
+        while(true) {
+            if(level == levels.size()) {
+                return npos;
+            }
+            size_t word = pos / 64;
+            if(word >= levels[level].size()) {
+                return npos;
+            }
+            uint64_t mask = (pos % 64) ? levels[level][word] & (~0ull << (pos % 64)) : levels[level][word];
+            if(mask) {
+                pos = word * 64 + __builtin_ctzll(mask);
+                break;
+            }
+            pos = word + 1;
+            level++;
+        }
+
+        //Descend to the lowest set bit under it
+        while(level > 0) {
+            level--;
+            pos = pos * 64 + __builtin_ctzll(levels[level][pos]);
+        }
+        return pos;
+    }
+
+private:
+    std::vector<std::vector<uint64_t>> levels;
+};
+
+/**
+ * \brief latency histogram of allocation calls, reported as percentiles at the end of a run
+ *
+ * Log-linear buckets: exact below 8 ns, then 8 per power of two, so a
+ * percentile is within 12.5% of the true value. The histogram has a fixed
+ * size however long the run is; recording a sample is O(1) and a report walks
+ * the buckets once.
+ *
+ */
+struct latency_stats {
+    static constexpr unsigned int sub_bits = 3;     //log2 of the buckets per power of two
+    static constexpr unsigned int sub_buckets = 1u << sub_bits;
+    static constexpr unsigned int bucket_count = (64 - sub_bits + 1) * sub_buckets;
+
+    uint64_t    counts[bucket_count] = {};
+    uint64_t    calls = 0;
+    uint64_t    max = 0;        //nanoseconds
+
+    void add(std::chrono::steady_clock::duration elapsed) {
+        uint64_t ns = std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), 0);
+        counts[bucket_of(ns)]++;
+        calls++;
+        max = std::max(max, ns);
+    }
+
+    void report(std::ostream& out, const char* label) const {
+        if(calls == 0) {
+            return;
+        }
+        out << label << ": " << calls << " call(s), p50 " << percentile(0.5) << " ns, p90 "
+            << percentile(0.9) << " ns, p99 " << percentile(0.99) << " ns, max " << max << " ns" << std::endl;
+    }
+
+private:
+    static unsigned int bucket_of(uint64_t ns) {
+        if(ns < sub_buckets) {
+            return ns;
+        }
+        unsigned int exponent = 63 - __builtin_clzll(ns);
+        unsigned int sub = (ns >> (exponent - sub_bits)) & (sub_buckets - 1);
+        return (exponent - sub_bits + 1) * sub_buckets + sub;
+    }
+
+    //Largest value a bucket holds
+    static uint64_t bucket_top(unsigned int bucket) {
+        if(bucket < sub_buckets) {
+            return bucket;
+        }
+        unsigned int exponent = bucket / sub_buckets + sub_bits - 1;
+        uint64_t low = (uint64_t)(sub_buckets + bucket % sub_buckets) << (exponent - sub_bits);
+        return low + ((1ull << (exponent - sub_bits)) - 1);
+    }
+
+    //Upper bound of the bucket holding the sample of rank p * (calls - 1), capped at the max
+    uint64_t percentile(double p) const {
+        uint64_t rank = (uint64_t)(p * (calls - 1));
+        uint64_t seen = 0;
+        for(unsigned int bucket = 0; bucket < bucket_count; bucket++) {
+            seen += counts[bucket];
+            if(seen > rank) {
+                return std::min(bucket_top(bucket), max);
+            }
+        }
+        return max;
+    }
+};
+
+//Interface of the simulated memory models. Handles are what PCBs show as their partition number.
+class memory_manager {
+public:
+    virtual ~memory_manager() = default;
+
+    //Returns the handle of the memory given to the program, or -1 if it does not fit
+    virtual int allocate(unsigned int size, const std::string& program_name) = 0;
+
+    //Releases a handle; unknown handles are ignored
+    virtual void release(int handle) = 0;
+
+    //Whether a program of size Mb would fit once the handles in released were released too.
+    //Models whose allocations cannot fail keep this default.
+    virtual bool fits_after(unsigned int /*size*/, const std::vector<int>& /*released*/) const {
+        return true;
+    }
+
+    //Relocates resident programs so that size Mb fit, if that helps. Returns the Mb moved.
+    virtual unsigned int compact(unsigned int /*size*/) {
+        return 0;
+    }
+
+    //End of run summary
+    virtual void report(std::ostream& out) const = 0;
+};
+
+/**
+ * \brief fixed partition table with best-fit allocation
+ *
+ * Slots order the partitions by size (equal sizes: higher partition number
+ * first, like scanning the table from the last partition down), so every
+ * partition large enough for a program sits at or after the slot found by a
+ * binary search on size. Best fit is then the next free slot from there in the
+ * free bitmap: O(log n) for any number of partitions.
+ *
+ */
+class partition_table : public memory_manager {
+public:
+    std::vector<memory_partition_t> partitions;    //by partition number - 1
+
+    partition_table(const std::vector<unsigned int>& sizes) {
+        load(sizes);
+    }
+
+    //Replaces the layout; partitions are numbered from 1 in the order given
+    void load(const std::vector<unsigned int>& sizes) {
+        partitions.clear();
+        partitions.reserve(sizes.size());
+        for(unsigned int i = 0; i < sizes.size(); i++) {
+            partitions.emplace_back(i + 1, sizes[i], "");
+        }
+
+        by_slot.resize(sizes.size());
+        for(unsigned int i = 0; i < sizes.size(); i++) {
+            by_slot[i] = i;
+        }
+        std::stable_sort(by_slot.begin(), by_slot.end(), [&](unsigned int a, unsigned int b) {
+            return sizes[a] < sizes[b] || (sizes[a] == sizes[b] && a > b);
+        });
+
+        slot_of.resize(sizes.size());
+        slot_sizes.resize(sizes.size());
+        for(unsigned int slot = 0; slot < sizes.size(); slot++) {
+            slot_of[by_slot[slot]] = slot;
+            slot_sizes[slot] = sizes[by_slot[slot]];
+        }
+        free.reset(sizes.size(), true);
+    }
+
+    size_t size() const {
+        return partitions.size();
+    }
+
+    //Best fit: the smallest empty partition of at least size Mb. Returns its number, or -1.
+    int allocate(unsigned int size, const std::string& program_name) override {
+        size_t first = std::lower_bound(slot_sizes.begin(), slot_sizes.end(), size) - slot_sizes.begin();
+        size_t slot = free.find_next(first);
+        if(slot == free_bitmap::npos) {
+            return -1;
+        }
+
+        free.clear(slot);
+        memory_partition_t& partition = partitions[by_slot[slot]];
+        partition.code = program_name;
+        return partition.partition_number;
+    }
+
+    void release(int partition_number) override {
+        if(partition_number < 1 || (size_t)partition_number > partitions.size()) {
+            return;
+        }
+        unsigned int i = partition_number - 1;
+        free.set(slot_of[i]);
+        partitions[i].code.clear();
+    }
+
+    bool fits_after(unsigned int size, const std::vector<int>& released) const override {
+        size_t first = std::lower_bound(slot_sizes.begin(), slot_sizes.end(), size) - slot_sizes.begin();
+        if(free.find_next(first) != free_bitmap::npos) {
+            return true;
+        }
+        for(int partition_number : released) {
+            if(partition_number >= 1 && (size_t)partition_number <= partitions.size()
+               && partitions[partition_number - 1].size >= size) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void report(std::ostream& out) const override {
+        size_t in_use = 0;
+        for(const auto& partition : partitions) {
+            in_use += !partition.code.empty();
+        }
+        out << "Fixed partitions: " << partitions.size() << " partition(s), " << in_use << " in use" << std::endl;
+    }
+
+private:
+    std::vector<unsigned int>   by_slot;    //slot -> index into partitions
+    std::vector<unsigned int>   slot_of;    //index into partitions -> slot
+    std::vector<unsigned int>   slot_sizes; //slot -> partition size, ascending
+    free_bitmap                 free;       //slot bit set: partition is empty
+};
+
+//Placement policies of the variable partition memory
+enum class fit_policy {
+    FIRST,  //lowest address hole that fits
+    BEST,   //smallest hole that fits
+    WORST,  //largest hole
+    NEXT    //first fit, starting where the previous search stopped
+};
+
+/**
+ * \brief contiguous memory with variable partitions
+ *
+ * Every allocation is carved out of a hole of exactly the size asked for.
+ * Holes are kept in an address-ordered tree, so freed blocks coalesce with
+ * their neighbours, and in a (size, address) ordered tree, so best and worst
+ * fit are O(log n). First and next fit walk holes in address order.
+ *
+ */
+class variable_memory : public memory_manager {
+public:
+    variable_memory(unsigned int total_size, fit_policy policy):
+        total_size(total_size), policy(policy), rover(0), next_handle(1), free_total(0), failures(0), fragmentation_failures(0),
+        compactions(0), relocated(0) {
+        if(total_size > 0) {
+            add_hole(0, total_size);
+        }
+    }
+
+    int allocate(unsigned int size, const std::string& program_name) override {
+        auto hole = find_hole(size);
+        if(hole == holes.end()) {
+            failures++;
+            if(free_size() >= size) {
+                fragmentation_failures++; //enough memory in total, but not in one piece
+            }
+            return -1;
+        }
+
+        unsigned int address = hole->first;
+        unsigned int hole_size = hole->second;
+        remove_hole(hole);
+        if(hole_size > size) {
+            add_hole(address + size, hole_size - size);
+        }
+        rover = address + size;
+
+        int handle = next_handle++;
+        blocks.emplace(handle, block{address, size, program_name});
+        return handle;
+    }
+
+    void release(int handle) override {
+        auto found = blocks.find(handle);
+        if(found == blocks.end()) {
+            return;
+        }
+        unsigned int address = found->second.address;
+        unsigned int size = found->second.size;
+        blocks.erase(found);
+
+        //Coalesce with the holes on either side
+        auto next = holes.lower_bound(address);
+        if(next != holes.end() && next->first == address + size) {
+            size += next->second;
+            next = remove_hole(next);
+        }
+        if(next != holes.begin()) {
+            auto previous = std::prev(next);
+            if(previous->first + previous->second == address) {
+                address = previous->first;
+                size += previous->second;
+                remove_hole(previous);
+            }
+        }
+        add_hole(address, size);
+    }
+
+    unsigned int free_size() const {
+        return free_total;
+    }
+
+    //Coalesces the released blocks with the holes, in address order, looking for a big enough run
+    bool fits_after(unsigned int size, const std::vector<int>& released) const override {
+        if(!holes_by_size.empty() && holes_by_size.rbegin()->first >= size) {
+            return true;
+        }
+
+        std::vector<std::pair<unsigned int, unsigned int>> runs(holes.begin(), holes.end()); //(address, size)
+        for(int handle : released) {
+            auto found = blocks.find(handle);
+            if(found != blocks.end()) {
+                runs.emplace_back(found->second.address, found->second.size);
+            }
+        }
+        std::sort(runs.begin(), runs.end());
+
+        unsigned int run_end = 0, run_size = 0;
+        for(const auto& [address, length] : runs) {
+            run_size = address == run_end ? run_size + length : length;
+            run_end = address + length;
+            if(run_size >= size) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //Slides every block down to the lowest addresses, leaving one hole at the top
+    unsigned int compact(unsigned int size) override {
+        if(free_total < size || (!holes_by_size.empty() && holes_by_size.rbegin()->first >= size)) {
+            return 0; //compaction cannot help, or is not needed
+        }
+
+        std::vector<std::pair<unsigned int, int>> by_address; //(address, handle)
+        by_address.reserve(blocks.size());
+        for(const auto& [handle, resident] : blocks) {
+            by_address.emplace_back(resident.address, handle);
+        }
+        std::sort(by_address.begin(), by_address.end());
+
+        unsigned int moved = 0;
+        unsigned int address = 0;
+        for(const auto& [old_address, handle] : by_address) {
+            block& resident = blocks[handle];
+            if(old_address != address) {
+                resident.address = address;
+                moved += resident.size;
+            }
+            address += resident.size;
+        }
+
+        holes.clear();
+        holes_by_size.clear();
+        free_total = 0;
+        if(address < total_size) {
+            add_hole(address, total_size - address);
+        }
+        rover = address;
+
+        compactions++;
+        relocated += moved;
+        return moved;
+    }
+
+    void report(std::ostream& out) const override {
+        static const char* policy_names[] = {"first", "best", "worst", "next"};
+        unsigned int free = free_size();
+        unsigned int largest = holes_by_size.empty() ? 0 : holes_by_size.rbegin()->first;
+
+        out << "Variable partitions (" << policy_names[(int)policy] << " fit): " << total_size << " Mb, "
+            << total_size - free << " Mb in " << blocks.size() << " block(s), " << free << " Mb free in "
+            << holes.size() << " hole(s)" << std::endl;
+        out << "  largest hole: " << largest << " Mb, external fragmentation: "
+            << (free ? 100.0 * (free - largest) / free : 0.0) << "%" << std::endl;
+        out << "  failed allocations: " << failures << " (" << fragmentation_failures
+            << " with enough free memory in total)" << std::endl;
+        if(compactions) {
+            out << "  compactions: " << compactions << ", " << relocated << " Mb relocated" << std::endl;
+        }
+    }
+
+private:
+    struct block {
+        unsigned int    address;
+        unsigned int    size;
+        std::string     program_name;
+    };
+
+    using hole_iterator = std::map<unsigned int, unsigned int>::iterator;
+
+    void add_hole(unsigned int address, unsigned int size) {
+        holes.emplace(address, size);
+        holes_by_size.emplace(size, address);
+        free_total += size;
+    }
+
+    hole_iterator remove_hole(hole_iterator hole) {
+        holes_by_size.erase({hole->second, hole->first});
+        free_total -= hole->second;
+        return holes.erase(hole);
+    }
+
+    hole_iterator find_hole(unsigned int size) {
+        switch(policy) {
+        case fit_policy::BEST: {
+            auto best = holes_by_size.lower_bound({size, 0});
+            return best == holes_by_size.end() ? holes.end() : holes.find(best->second);
+        }
+        case fit_policy::WORST: {
+            if(holes_by_size.empty() || holes_by_size.rbegin()->first < size) {
+                return holes.end();
+            }
+            return holes.find(holes_by_size.rbegin()->second);
+        }
+        case fit_policy::NEXT: {
+            //From the rover to the end, then wrap around
+            for(auto hole = holes.lower_bound(rover); hole != holes.end(); ++hole) {
+                if(hole->second >= size) {
+                    return hole;
+                }
+            }
+            for(auto hole = holes.begin(); hole != holes.end() && hole->first < rover; ++hole) {
+                if(hole->second >= size) {
+                    return hole;
+                }
+            }
+            return holes.end();
+        }
+        case fit_policy::FIRST:
+        default:
+            for(auto hole = holes.begin(); hole != holes.end(); ++hole) {
+                if(hole->second >= size) {
+                    return hole;
+                }
+            }
+            return holes.end();
+        }
+    }
+
+    unsigned int                                        total_size;
+    fit_policy                                          policy;
+    unsigned int                                        rover;          //next fit resumes here
+    int                                                 next_handle;
+    std::map<unsigned int, unsigned int>                holes;          //address -> size
+    std::set<std::pair<unsigned int, unsigned int>>     holes_by_size;  //(size, address)
+    std::unordered_map<int, block>                      blocks;         //handle -> block
+    unsigned int                                        free_total;     //sum of the hole sizes
+    size_t                                              failures;
+    size_t                                              fragmentation_failures;
+    size_t                                              compactions;
+    size_t                                              relocated;      //Mb moved by compactions
+};
+
+/**
+ * \brief binary buddy allocator
+ *
+ * Memory is a power of two Mb, split in halves until a block is the smallest
+ * power of two that holds the program. Each order has a free list whose
+ * next/prev links are kept in a hash of the free block addresses, so the buddy
+ * of a freed block is checked and unlinked in O(1) and the footprint grows with
+ * the free blocks rather than the memory size. A mask of non-empty orders finds
+ * the order to split from with one ctz. Allocation and free are O(log n) in the
+ * memory size.
+ *
+ */
+class buddy_memory : public memory_manager {
+public:
+    static constexpr unsigned int none = (unsigned int)-1;
+
+    //total_size must be a power of two
+    buddy_memory(unsigned int total_size):
+        total_size(total_size), max_order(__builtin_ctz(total_size)), nonempty(0), next_handle(1),
+        heads(max_order + 1, none), free_blocks(max_order + 1),
+        requested_live(0), block_live(0), requested_total(0), block_total(0), failures(0) {
+        push(0, max_order);
+    }
+
+    int allocate(unsigned int size, const std::string& program_name) override {
+        unsigned int order = order_of(size);
+        uint64_t candidates = order <= max_order ? nonempty & (~0ull << order) : 0;
+        if(candidates == 0) {
+            failures++;
+            return -1;
+        }
+
+        //Take the smallest free block that fits and split it down to the order needed
+        unsigned int from = __builtin_ctzll(candidates);
+        unsigned int address = heads[from];
+        unlink(address, from);
+        while(from > order) {
+            from--;
+            push(address + (1u << from), from);
+        }
+
+        unsigned int block_size = 1u << order;
+        requested_live += size;
+        block_live += block_size;
+        requested_total += size;
+        block_total += block_size;
+
+        int handle = next_handle++;
+        blocks.emplace(handle, block{address, order, size, program_name});
+        return handle;
+    }
+
+    void release(int handle) override {
+        auto found = blocks.find(handle);
+        if(found == blocks.end()) {
+            return;
+        }
+        unsigned int address = found->second.address;
+        unsigned int order = found->second.order;
+        requested_live -= found->second.size;
+        block_live -= 1u << order;
+        blocks.erase(found);
+
+        //Merge with the buddy for as long as it is free
+        while(order < max_order) {
+            unsigned int buddy = address ^ (1u << order);
+            if(!free_blocks[order].count(buddy)) {
+                break;
+            }
+            unlink(buddy, order);
+            address &= ~(1u << order);
+            order++;
+        }
+        push(address, order);
+    }
+
+    //Replays the buddy merges of the released blocks on a copy of the free block addresses
+    bool fits_after(unsigned int size, const std::vector<int>& released) const override {
+        unsigned int order = order_of(size);
+        if(order > max_order) {
+            return false;
+        }
+        if(nonempty >> order) {
+            return true;
+        }
+
+        std::vector<std::set<unsigned int>> free_sets(max_order + 1);
+        for(unsigned int k = 0; k <= max_order; k++) {
+            for(const auto& entry : free_blocks[k]) {
+                free_sets[k].insert(entry.first);
+            }
+        }
+        for(int handle : released) {
+            auto found = blocks.find(handle);
+            if(found == blocks.end()) {
+                continue;
+            }
+            unsigned int address = found->second.address;
+            unsigned int k = found->second.order;
+            while(k < max_order && free_sets[k].erase(address ^ (1u << k))) {
+                address &= ~(1u << k);
+                k++;
+            }
+            if(k >= order) {
+                return true;
+            }
+            free_sets[k].insert(address);
+        }
+        return false;
+    }
+
+    void report(std::ostream& out) const override {
+        size_t free_lists = 0;
+        for(const auto& free_list : free_blocks) {
+            free_lists += free_list.size();
+        }
+
+        out << "Buddy memory: " << total_size << " Mb, " << block_live << " Mb in " << blocks.size()
+            << " block(s), " << free_lists << " free block(s)" << std::endl;
+        out << "  internal fragmentation: " << block_live - requested_live << " Mb now, "
+            << (block_total ? 100.0 * (block_total - requested_total) / block_total : 0.0)
+            << "% of all memory handed out" << std::endl;
+        out << "  failed allocations: " << failures << std::endl;
+    }
+
+private:
+    struct block {
+        unsigned int    address;
+        unsigned int    order;
+        unsigned int    size;           //Mb asked for
+        std::string     program_name;
+    };
+
+    //Smallest order whose blocks hold size Mb
+    static unsigned int order_of(unsigned int size) {
+        return size <= 1 ? 0 : 32 - __builtin_clz(size - 1);
+    }
+
+    //Free list links of a free block
+    struct links {
+        unsigned int    next;
+        unsigned int    prev;
+    };
+
+    void push(unsigned int address, unsigned int order) {
+        auto& free_list = free_blocks[order];
+        free_list[address] = {heads[order], none};
+        if(heads[order] != none) {
+            free_list[heads[order]].prev = address;
+        }
+        heads[order] = address;
+        nonempty |= 1ull << order;
+    }
+
+    void unlink(unsigned int address, unsigned int order) {
+        auto& free_list = free_blocks[order];
+        auto found = free_list.find(address);
+        links unlinked = found->second;
+        free_list.erase(found);
+        if(unlinked.prev != none) {
+            free_list[unlinked.prev].next = unlinked.next;
+        } else {
+            heads[order] = unlinked.next;
+        }
+        if(unlinked.next != none) {
+            free_list[unlinked.next].prev = unlinked.prev;
+        }
+        if(heads[order] == none) {
+            nonempty &= ~(1ull << order);
+        }
+    }
+
+    unsigned int                                         total_size;
+    unsigned int                                         max_order;
+    uint64_t                                             nonempty;       //bit k set: order k has a free block
+    int                                                  next_handle;
+    std::vector<unsigned int>                            heads;          //first free block of each order
+    std::vector<std::unordered_map<unsigned int, links>> free_blocks;    //by order, free block address -> links
+    std::unordered_map<int, block>                       blocks;         //handle -> block
+    size_t                                               requested_live; //Mb asked for by the live blocks
+    size_t                                               block_live;     //Mb held by the live blocks
+    size_t                                               requested_total;
+    size_t                                               block_total;
+    size_t                                               failures;
+};
+
+//Page replacement policies of the paged memory
+enum class replacement_policy {
+    FIFO,   //oldest loaded page
+    CLOCK,  //second chance sweep, an approximation of LRU
+    LFU     //least referenced page, oldest first on ties
+};
+
+//What a page reference cost
+enum class page_access {
+    TLB_HIT,
+    TLB_MISS,   //found in the page table
+    PAGE_FAULT, //loaded into a frame, maybe evicting another page
+    UNMAPPED    //the handle has no address space; counted, never a hit
+};
+
+/**
+ * \brief demand paged virtual memory with a TLB
+ *
+ * allocate() only creates a page table; pages are loaded into frames the first
+ * time they are touched. Every replacement policy is O(1) per reference: FIFO
+ * is an intrusive list of frames in load order, clock a reference bit per
+ * frame and a sweeping hand, and LFU a list of frequency buckets, each with
+ * its frames in load order. The TLB is fully associative with LRU replacement.
+ *
+ */
+class paged_memory : public memory_manager {
+public:
+    static constexpr unsigned int none = (unsigned int)-1;
+
+    paged_memory(unsigned int frame_count, unsigned int page_size, unsigned int tlb_size, replacement_policy policy):
+        page_size(page_size), tlb_size(tlb_size), policy(policy), next_handle(1), frames(frame_count),
+        fifo_head(none), fifo_tail(none), hand(0),
+        references(0), tlb_hits(0), tlb_misses(0), faults(0), evictions(0), unmapped(0) {
+        for(unsigned int frame = frame_count; frame > 0; frame--) {
+            free_frames.push_back(frame - 1);
+        }
+    }
+
+    //Creates the page table of a program; it does not take any frame yet
+    int allocate(unsigned int size, const std::string& program_name) override {
+        unsigned int pages = size > page_size ? (size + page_size - 1) / page_size : 1;
+        int handle = next_handle++;
+        address_space& space = spaces[handle];
+        space.table.assign(pages, none);
+        space.program_name = program_name;
+        space.random = (uint32_t)handle * 2654435761u | 1;
+        return handle;
+    }
+
+    void release(int handle) override {
+        auto found = spaces.find(handle);
+        if(found == spaces.end()) {
+            return;
+        }
+        const std::vector<unsigned int>& table = found->second.table;
+        for(unsigned int page = 0; page < table.size(); page++) {
+            if(table[page] != none) {
+                tlb_remove(key_of(handle, page));
+                policy_remove(table[page]);
+                frames[table[page]].handle = -1;
+                free_frames.push_back(table[page]);
+            }
+        }
+        spaces.erase(found);
+    }
+
+    /**
+     * References the next page of a program. References have locality: most
+     * stay on or next to the previous page, the rest jump to a random page.
+     * The page referenced is returned in page.
+     */
+    page_access touch(int handle, unsigned int& page) {
+        auto found = spaces.find(handle);
+        if(found == spaces.end()) {
+            unmapped++;
+            return page_access::UNMAPPED;
+        }
+        address_space& space = found->second;
+        page = next_reference(space);
+        references++;
+
+        uint64_t key = key_of(handle, page);
+        auto cached = tlb_index.find(key);
+        if(cached != tlb_index.end()) {
+            tlb_hits++;
+            tlb_entries.splice(tlb_entries.begin(), tlb_entries, cached->second);
+            policy_access(space.table[page]);
+            return page_access::TLB_HIT;
+        }
+
+        if(space.table[page] != none) {
+            tlb_misses++;
+            tlb_insert(key);
+            policy_access(space.table[page]);
+            return page_access::TLB_MISS;
+        }
+
+        faults++;
+        unsigned int frame;
+        if(!free_frames.empty()) {
+            frame = free_frames.back();
+            free_frames.pop_back();
+        } else {
+            frame = policy_victim();
+            evictions++;
+            frame_entry& victim = frames[frame];
+            tlb_remove(key_of(victim.handle, victim.page));
+            spaces[victim.handle].table[victim.page] = none;
+            policy_remove(frame);
+        }
+
+        frames[frame].handle = handle;
+        frames[frame].page = page;
+        space.table[page] = frame;
+        policy_insert(frame);
+        tlb_insert(key);
+        return page_access::PAGE_FAULT;
+    }
+
+    void report(std::ostream& out) const override {
+        static const char* policy_names[] = {"FIFO", "clock", "LFU"};
+        auto percent = [&](size_t count) { return references ? 100.0 * count / references : 0.0; };
+
+        out << "Paged memory (" << policy_names[(int)policy] << " replacement): " << frames.size()
+            << " frame(s) of " << page_size << " Mb, " << tlb_size << " TLB entries" << std::endl;
+        out << "  references: " << references << ", TLB hit ratio: " << percent(tlb_hits) << "%, page table hits: "
+            << tlb_misses << std::endl;
+        out << "  page faults: " << faults << " (fault rate " << percent(faults) << "%), evictions: "
+            << evictions << std::endl;
+        if(unmapped) {
+            out << "  references to no address space: " << unmapped << std::endl;
+        }
+    }
+
+private:
+    struct address_space {
+        std::vector<unsigned int>   table;          //page -> frame, or none
+        std::string                 program_name;
+        uint32_t                    random;         //xorshift state of the reference string
+        unsigned int                last_page = 0;
+    };
+
+    struct lfu_bucket {
+        size_t                      count;          //references of every frame in the bucket
+        std::list<unsigned int>     frames;         //in load order
+    };
+
+    struct frame_entry {
+        int                                     handle = -1;    //owner, -1 if free
+        unsigned int                            page = 0;
+        unsigned int                            next = none;    //FIFO links
+        unsigned int                            prev = none;
+        bool                                    referenced = false;
+        std::list<lfu_bucket>::iterator         bucket;
+        std::list<unsigned int>::iterator       position;       //in bucket->frames
+    };
+
+    static uint64_t key_of(int handle, unsigned int page) {
+        return (uint64_t)(uint32_t)handle << 32 | page;
+    }
+
+    unsigned int next_reference(address_space& space) {
+        space.random ^= space.random << 13;
+        space.random ^= space.random >> 17;
+        space.random ^= space.random << 5;
+
+        unsigned int pages = space.table.size();
+        unsigned int roll = space.random % 10;
+        if(roll < 5) {
+            //same page
+        } else if(roll < 8) {
+            space.last_page = (space.last_page + 1) % pages;
+        } else {
+            space.last_page = (space.random >> 8) % pages;
+        }
+        return space.last_page;
+    }
+
+    void tlb_insert(uint64_t key) {
+        if(tlb_size == 0) {
+            return;
+        }
+        if(tlb_entries.size() == tlb_size) {
+            tlb_index.erase(tlb_entries.back());
+            tlb_entries.pop_back();
+        }
+        tlb_entries.push_front(key);
+        tlb_index[key] = tlb_entries.begin();
+    }
+
+    void tlb_remove(uint64_t key) {
+        auto cached = tlb_index.find(key);
+        if(cached != tlb_index.end()) {
+            tlb_entries.erase(cached->second);
+            tlb_index.erase(cached);
+        }
+    }
+
+    //A page was just loaded into frame
+    void policy_insert(unsigned int frame) {
+        frame_entry& entry = frames[frame];
+        switch(policy) {
+        case replacement_policy::FIFO:
+            entry.prev = fifo_tail;
+            entry.next = none;
+            if(fifo_tail != none) {
+                frames[fifo_tail].next = frame;
+            } else {
+                fifo_head = frame;
+            }
+            fifo_tail = frame;
+            break;
+        case replacement_policy::CLOCK:
+            entry.referenced = true;
+            break;
+        case replacement_policy::LFU:
+            if(lfu_buckets.empty() || lfu_buckets.front().count != 1) {
+                lfu_buckets.push_front({1, {}});
+            }
+            entry.bucket = lfu_buckets.begin();
+            entry.position = entry.bucket->frames.insert(entry.bucket->frames.end(), frame);
+            break;
+        }
+    }
+
+    //The page in frame was referenced again
+    void policy_access(unsigned int frame) {
+        frame_entry& entry = frames[frame];
+        switch(policy) {
+        case replacement_policy::FIFO:
+            break;
+        case replacement_policy::CLOCK:
+            entry.referenced = true;
+            break;
+        case replacement_policy::LFU: {
+            auto bucket = entry.bucket;
+            auto next = std::next(bucket);
+            if(next == lfu_buckets.end() || next->count != bucket->count + 1) {
+                next = lfu_buckets.insert(next, {bucket->count + 1, {}});
+            }
+            next->frames.splice(next->frames.end(), bucket->frames, entry.position);
+            entry.bucket = next;
+            if(bucket->frames.empty()) {
+                lfu_buckets.erase(bucket);
+            }
+            break;
+        }
+        }
+    }
+
+    //The page in frame is leaving it
+    void policy_remove(unsigned int frame) {
+        frame_entry& entry = frames[frame];
+        switch(policy) {
+        case replacement_policy::FIFO:
+            if(entry.prev != none) {
+                frames[entry.prev].next = entry.next;
+            } else {
+                fifo_head = entry.next;
+            }
+            if(entry.next != none) {
+                frames[entry.next].prev = entry.prev;
+            } else {
+                fifo_tail = entry.prev;
+            }
+            break;
+        case replacement_policy::CLOCK:
+            entry.referenced = false;
+            break;
+        case replacement_policy::LFU:
+            entry.bucket->frames.erase(entry.position);
+            if(entry.bucket->frames.empty()) {
+                lfu_buckets.erase(entry.bucket);
+            }
+            break;
+        }
+    }
+
+    //Frame whose page is evicted when no frame is free
+    unsigned int policy_victim() {
+        switch(policy) {
+        case replacement_policy::FIFO:
+            return fifo_head;
+        case replacement_policy::CLOCK: {
+            //Every frame is in use here; give referenced pages a second chance
+            while(frames[hand].referenced) {
+                frames[hand].referenced = false;
+                hand = (hand + 1) % frames.size();
+            }
+            unsigned int victim = hand;
+            hand = (hand + 1) % frames.size();
+            return victim;
+        }
+        case replacement_policy::LFU:
+        default:
+            return lfu_buckets.front().frames.front();
+        }
+    }
+
+    unsigned int                                            page_size;      //Mb
+    unsigned int                                            tlb_size;
+    replacement_policy                                      policy;
+    int                                                     next_handle;
+    std::unordered_map<int, address_space>                  spaces;         //handle -> page table
+    std::vector<frame_entry>                                frames;
+    std::vector<unsigned int>                               free_frames;
+    unsigned int                                            fifo_head;
+    unsigned int                                            fifo_tail;
+    unsigned int                                            hand;           //clock hand
+    std::list<lfu_bucket>                                   lfu_buckets;    //ascending count
+    std::list<uint64_t>                                     tlb_entries;    //most recently used first
+    std::unordered_map<uint64_t, std::list<uint64_t>::iterator> tlb_index;
+    size_t                                                  references;
+    size_t                                                  tlb_hits;
+    size_t                                                  tlb_misses;
+    size_t                                                  faults;
+    size_t                                                  evictions;
+    size_t                                                  unmapped;       //touches of a handle with no page table
+};
+
+#endif
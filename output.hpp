@@ -0,0 +1,318 @@
+/**
+ * @file output.hpp
+ *
+ * Output side of the simulator: the buffered file sink, the execution log
+ * events, and the compact binary execution log format.
+ */
+
+#ifndef OUTPUT_HPP_
+#define OUTPUT_HPP_
+
+#include<iostream>
+#include<fstream>
+#include<string>
+#include<vector>
+#include<charconv>
+#include<cstdint>
+#include<string_view>
+#include<type_traits>
+#include<string.h>
+
+/**
+ * \brief buffered output file
+ *
+ * The simulator appends log text straight into the sink, which writes it to the
+ * file in large chunks whenever the buffer fills. Memory use is bounded by the
+ * buffer capacity no matter how long the simulation runs. A sink constructed
+ * without a file name only counts the bytes it is given.
+ * 
+ */
+class output_sink {
+public:
+    static const size_t default_capacity = 1 << 20;
+
+    output_sink(const char* filename = nullptr, size_t capacity = default_capacity):
+        name(filename ? filename : ""), capacity(capacity), written(0) {
+        buffer.reserve(capacity);
+        if(filename) {
+            file.open(filename);
+            if(!file.is_open()) {
+                std::cerr << "Error opening file!" << std::endl;
+            }
+        }
+    }
+
+    //Flushes and closes without telling anyone, since the run may have failed
+    ~output_sink() {
+        if(file.is_open()) {
+            flush();
+            file.close();
+        }
+    }
+
+    void append(const char* text, size_t length) {
+        written += length;
+        if(buffer.size() + length > capacity) {
+            flush();
+            if(length > capacity) {
+                write_file(text, length); //too big to buffer, write it through
+                return;
+            }
+        }
+        buffer.append(text, length);
+    }
+
+    output_sink& operator<<(std::string_view text) {
+        append(text.data(), text.size());
+        return *this;
+    }
+
+    output_sink& operator<<(const char* text) {
+        append(text, strlen(text));
+        return *this;
+    }
+
+    output_sink& operator<<(const std::string& text) {
+        append(text.data(), text.size());
+        return *this;
+    }
+
+    //Numbers are formatted with std::to_chars straight into the buffer
+    template<typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    output_sink& operator<<(T value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        append(digits, result.ptr - digits);
+        return *this;
+    }
+
+    void flush() {
+        write_file(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    //Flushes what is left and closes the file, telling log about it
+    void close(std::ostream& log = std::cout) {
+        if(!file.is_open()) {
+            return;
+        }
+        flush();
+        file.close();
+        log << "File content overwritten successfully." << std::endl;
+        log << "Output generated in " << name << std::endl;
+    }
+
+    //Total number of bytes appended so far
+    size_t size() const {
+        return written;
+    }
+
+private:
+    void write_file(const char* text, size_t length) {
+        if(file.is_open()) {
+            file.write(text, length);
+        }
+    }
+
+    std::string     name;
+    std::ofstream   file;
+    std::string     buffer;
+    size_t          capacity;
+    size_t          written;
+};
+
+//Everything the simulator writes to the execution log
+enum class log_event : uint16_t {
+    SWITCH_TO_KERNEL,
+    CONTEXT_SAVED,
+    FIND_VECTOR,        //operand: interrupt number
+    LOAD_ADDRESS,       //operand: interrupt number
+    CPU_BURST,
+    SYSCALL_ISR,
+    ENDIO_ISR,
+    IRET,
+    CLONE_PCB,
+    SCHEDULER,
+    PROGRAM_SIZE,       //operand: program size in Mb
+    LOAD_PROGRAM,
+    MARK_PARTITION,
+    UPDATE_PCB,
+    PAGE_FAULT_ISR,     //operand: page number
+    COMPACTION,         //operand: Mb relocated
+    SWAP_OUT,           //operand: PID
+    SWAP_IN_ISR,        //operand: PID
+    COPY_MEMORY,        //operand: Mb copied
+    DISPATCH,           //operand: PID
+    IO_REQUEST,         //operand: device
+    IO_COMPLETE,        //operand: PID
+    CPU_IDLE,
+    EVENT_COUNT
+};
+
+//Message text of each event, in log_event order
+const char* const event_messages[] = {
+    "switch to kernel mode",
+    "context saved",
+    "find vector",
+    "load address",
+    "CPU Burst",
+    "SYSCALL ISR",
+    "ENDIO ISR",
+    "IRET",
+    "cloning the PCB",
+    "scheduler called",
+    "Program is",
+    "loading program into memory",
+    "marking partition as occupied",
+    "updating PCB",
+    "page fault ISR",
+    "compacting memory",
+    "swapping out",
+    "swap in ISR",
+    "copying memory",
+    "dispatching",
+    "starting I/O",
+    "I/O complete",
+    "CPU idle"
+};
+
+static_assert(sizeof(event_messages) / sizeof(event_messages[0]) == (size_t)log_event::EVENT_COUNT,
+              "every log_event needs a message");
+
+/**
+ * Binary execution log layout (native byte order):
+ *   "SIMEXEC3"                                  8 byte magic, its last byte the format version
+ *   u32 vector count
+ *   string table: the vector table, then the memory position of every vector;
+ *   each string is a u32 length and its bytes
+ *   binary_record per log line until the end of the file
+ * Times, durations and operands keep the full width the simulator records them
+ * with, so decoding reproduces the text log exactly. Event codes and their
+ * messages come from log_event and event_messages, so any change to them or
+ * to binary_record is a new format version.
+ */
+const char binary_log_magic[8] = {'S', 'I', 'M', 'E', 'X', 'E', 'C', '3'};
+
+static_assert((size_t)log_event::EVENT_COUNT == 23,
+              "log_event changed: bump the format version in binary_log_magic and this count");
+
+struct binary_record {
+    int32_t     time;
+    int32_t     duration;
+    uint32_t    operand;
+    uint16_t    event;
+    uint16_t    reserved;
+};
+
+static_assert(sizeof(binary_record) == 16, "binary_record must stay 16 bytes");
+
+//Writes one log line in the text format: "time, duration, message"
+void write_event_text(output_sink& sink, int64_t time, int32_t duration, log_event event, uint32_t operand,
+                      const std::vector<std::string>& vectors, const std::vector<std::string>& positions) {
+    sink << time << ", " << duration << ", ";
+
+    switch(event) {
+    case log_event::FIND_VECTOR:
+        sink << "find vector " << operand << " in memory position " << positions.at(operand) << "\n";
+        break;
+    case log_event::LOAD_ADDRESS:
+        sink << "load address " << vectors.at(operand) << " into the PC\n";
+        break;
+    case log_event::PROGRAM_SIZE:
+        sink << "Program is " << operand << " Mb large\n";
+        break;
+    case log_event::PAGE_FAULT_ISR:
+        sink << "page fault ISR: loading page " << operand << " into a frame\n";
+        break;
+    case log_event::COMPACTION:
+        sink << "compacting memory: relocating " << operand << " Mb\n";
+        break;
+    case log_event::SWAP_OUT:
+        sink << "swapping out PID " << operand << " to the backing store\n";
+        break;
+    case log_event::SWAP_IN_ISR:
+        sink << "swap in ISR: reading PID " << operand << " back from the backing store\n";
+        break;
+    case log_event::COPY_MEMORY:
+        sink << "copying " << operand << " Mb of the parent's memory\n";
+        break;
+    case log_event::DISPATCH:
+        sink << "scheduler called: dispatching PID " << operand << "\n";
+        break;
+    case log_event::IO_REQUEST:
+        sink << "SYSCALL ISR: starting I/O on device " << operand << "\n";
+        break;
+    case log_event::IO_COMPLETE:
+        sink << "I/O complete: PID " << operand << " is ready\n";
+        break;
+    default:
+        sink << event_messages[(size_t)event] << "\n";
+        break;
+    }
+}
+
+//Total duration and count of each event type, for runs that tally events instead of logging them
+struct event_tally {
+    int64_t     time[(size_t)log_event::EVENT_COUNT] = {};
+    uint64_t    count[(size_t)log_event::EVENT_COUNT] = {};
+};
+
+/**
+ * \brief execution log writer
+ *
+ * The simulator records events here; they are written to the sink either as the
+ * usual text lines or, in binary mode, as fixed-width binary_records after a
+ * string table header. decode_execution turns a binary log back into text.
+ * Given a tally, events are only added up there and nothing is written.
+ * 
+ */
+class execution_log {
+public:
+    execution_log(output_sink& sink, const std::vector<std::string>& vectors,
+                  const std::vector<std::string>& positions, bool binary = false, event_tally* tally = nullptr):
+        sink(sink), vectors(vectors), positions(positions), binary(binary), tally(tally) {
+        if(binary && !tally) {
+            write_header();
+        }
+    }
+
+    void record(int time, int duration, log_event event, uint32_t operand = 0) {
+        if(tally) {
+            tally->time[(size_t)event] += duration;
+            tally->count[(size_t)event]++;
+        } else if(binary) {
+            binary_record entry{time, duration, operand, (uint16_t)event, 0};
+            sink.append((const char*)&entry, sizeof(entry));
+        } else {
+            write_event_text(sink, time, duration, event, operand, vectors, positions);
+        }
+    }
+
+private:
+    void write_string(std::string_view text) {
+        uint32_t length = text.size();
+        sink.append((const char*)&length, sizeof(length));
+        sink.append(text.data(), text.size());
+    }
+
+    void write_header() {
+        uint32_t vector_count = vectors.size();
+
+        sink.append(binary_log_magic, sizeof(binary_log_magic));
+        sink.append((const char*)&vector_count, sizeof(vector_count));
+        for(const auto& vector : vectors) {
+            write_string(vector);
+        }
+        for(const auto& position : positions) {
+            write_string(position);
+        }
+    }
+
+    output_sink&                        sink;
+    const std::vector<std::string>&     vectors;
+    const std::vector<std::string>&     positions;
+    bool                                binary;
+    event_tally*                        tally;
+};
+
+#endif
@@ -0,0 +1,474 @@
+/**
+ * @file scheduler.hpp
+ *
+ * Scheduler mode: a FORKed child and its parent are both runnable. A ready
+ * queue and a dispatcher interleave the traces of every process under a
+ * scheduling policy, instead of the parent waiting for the child to finish.
+ * With asynchronous I/O, the event calendar of events.hpp lets device I/O
+ * complete while other processes run.
+ */
+
+#ifndef SCHEDULER_HPP_
+#define SCHEDULER_HPP_
+
+#include <simulator.hpp>
+#include <events.hpp>
+#include <climits>
+#include <deque>
+#include <queue>
+#include <tuple>
+
+//Number of MLFQ levels; level k has a quantum of quantum << k
+const int mlfq_levels = 3;
+
+//One process in scheduler mode, with the times its statistics are built from
+struct sim_process {
+    PCB                     current;
+    const compiled_trace*   trace;
+    size_t                  cursor;         //next instruction to run
+    bool                    borrowed;       //still sharing its parent's memory
+    int                     priority;       //lower runs first
+    int                     arrival;        //creation time
+    int                     remaining = 0;  //CPU time left in the burst being run
+    int                     level = 0;      //MLFQ level
+    int                     first_run = -1;
+    int                     finish = -1;
+    int                     ready_since = 0;
+    int                     waiting = 0;    //time spent in the ready queue
+
+    //CPU time of the burst it runs next: the rest of the current one, or the next CPU instruction's,
+    //following the jumps this process takes past FORK and IF_PARENT. A process that EXECs or
+    //finishes before its next burst has none known, and counts as 0.
+    int next_burst() const {
+        if (remaining > 0) {
+            return remaining;
+        }
+        size_t next = cursor;
+        while (next < trace->code.size()) {
+            const instruction& ins = trace->code[next];
+            switch (ins.op) {
+            case opcode::CPU:
+                if (ins.operand > 0) {
+                    return ins.operand;
+                }
+                next++;
+                break;
+            case opcode::FORK:
+                next = trace->forks[ins.target].parent_resume;
+                break;
+            case opcode::IF_PARENT:
+                next = ins.target;
+                break;
+            case opcode::EXEC:
+                return 0;
+            default:
+                next++;
+                break;
+            }
+        }
+        return 0;
+    }
+};
+
+/**
+ * \brief ready queue of a scheduling policy
+ *
+ * FCFS and round robin use a FIFO, MLFQ one FIFO per level, and the ordered
+ * policies (priority, SJF, SRTF) a heap on their key with arrival order
+ * breaking ties.
+ *
+ */
+class ready_queue {
+public:
+    ready_queue(scheduling_policy policy): policy(policy), levels(mlfq_levels), order(0) {}
+
+    //Ordering key of a process: lower runs first
+    long key_of(const sim_process& process) const {
+        switch (policy) {
+        case scheduling_policy::PRIORITY:
+            return process.priority;
+        case scheduling_policy::SJF:
+        case scheduling_policy::SRTF:
+            return process.next_burst();
+        case scheduling_policy::MLFQ:
+            return process.level;
+        default:
+            return 0;
+        }
+    }
+
+    void push(int index, const sim_process& process) {
+        switch (policy) {
+        case scheduling_policy::PRIORITY:
+        case scheduling_policy::SJF:
+        case scheduling_policy::SRTF:
+            ordered.push({key_of(process), order++, index});
+            break;
+        case scheduling_policy::MLFQ:
+            levels[process.level].push_back(index);
+            break;
+        default:
+            fifo.push_back(index);
+            break;
+        }
+    }
+
+    bool empty() const {
+        return fifo.empty() && ordered.empty() && best_level() == mlfq_levels;
+    }
+
+    //Removes and returns the process to run next
+    int pop() {
+        int index;
+        if (!ordered.empty()) {
+            index = std::get<2>(ordered.top());
+            ordered.pop();
+        } else if (!fifo.empty()) {
+            index = fifo.front();
+            fifo.pop_front();
+        } else {
+            std::deque<int>& level = levels[best_level()];
+            index = level.front();
+            level.pop_front();
+        }
+        return index;
+    }
+
+    //Whether a ready process should preempt running, under the preemptive policies
+    bool preempts(const sim_process& running) const {
+        switch (policy) {
+        case scheduling_policy::PRIORITY:
+        case scheduling_policy::SRTF:
+            return !ordered.empty() && std::get<0>(ordered.top()) < key_of(running);
+        case scheduling_policy::MLFQ:
+            return best_level() < running.level;
+        default:
+            return false;
+        }
+    }
+
+private:
+    int best_level() const {
+        int level = 0;
+        while (level < mlfq_levels && levels[level].empty()) {
+            level++;
+        }
+        return level;
+    }
+
+    using entry = std::tuple<long, uint64_t, int>;  //(key, arrival order, process)
+
+    scheduling_policy                                               policy;
+    std::deque<int>                                                 fifo;
+    std::vector<std::deque<int>>                                    levels;
+    std::priority_queue<entry, std::vector<entry>, std::greater<entry>> ordered;
+    uint64_t                                                        order;
+};
+
+//Scheduler settings, and the statistics of the finished processes
+struct scheduler {
+    scheduling_policy   policy;
+    int                 quantum;            //round robin quantum, and the top MLFQ level's
+    int                 timer_vector;       //interrupt vector of context switches
+    bool                async_io;           //SYSCALLs block on the device instead of running its ISR inline
+    size_t              context_switches = 0;
+    size_t              io_requests = 0;
+    long                idle = 0;           //time the CPU had nothing ready to run
+    size_t              completed = 0;
+    long                turnaround = 0;     //sums over the completed processes
+    long                waiting = 0;
+    long                response = 0;
+    int                 start = 0;
+    int                 end = 0;
+
+    //CPU time a process may run before it is preempted
+    int quantum_of(const sim_process& process) const {
+        switch (policy) {
+        case scheduling_policy::RR:
+            return quantum;
+        case scheduling_policy::MLFQ:
+            return quantum << process.level;
+        default:
+            return INT_MAX;
+        }
+    }
+
+    void finished(const sim_process& process) {
+        completed++;
+        turnaround += process.finish - process.arrival;
+        waiting += process.waiting;
+        response += process.first_run - process.arrival;
+    }
+
+    void report(std::ostream& out) const {
+        static const char* policy_names[] = {"none", "FCFS", "RR", "priority", "SJF", "SRTF", "MLFQ"};
+        int makespan = end - start;
+        auto average = [&](long total) { return completed ? (double)total / completed : 0.0; };
+
+        out << "Scheduler (" << policy_names[(int)policy] << "): " << completed << " process(es) in " << makespan
+            << " ms, throughput " << (makespan ? 1000.0 * completed / makespan : 0.0) << " per second, "
+            << context_switches << " context switch(es)" << std::endl;
+        out << "  average turnaround: " << average(turnaround) << " ms, waiting: " << average(waiting)
+            << " ms, response: " << average(response) << " ms" << std::endl;
+        if (async_io) {
+            out << "  " << io_requests << " asynchronous I/O request(s), CPU idle " << idle << " ms ("
+                << (makespan ? 100.0 * idle / makespan : 0.0) << "%)" << std::endl;
+        }
+    }
+};
+
+/**
+ * \brief runs a trace with every process scheduled concurrently
+ *
+ * FORK makes the child ready and the parent carries on after IF_PARENT. The
+ * dispatcher picks the next process whenever the running one exits, uses up
+ * its quantum while others are ready, or is preempted by a better one after a
+ * FORK or EXEC. Switching to another process costs a timer interrupt through
+ * intr_boilerplate. CPU bursts are the only preemptible work; SYSCALL, END_IO,
+ * FORK and EXEC run to completion in the kernel.
+ *
+ * With async_io a SYSCALL only starts the device: the process blocks, and an
+ * IO_COMPLETE event on the calendar makes it ready again once the device's
+ * delay has passed. Each device serves one request at a time. CPU bursts are
+ * cut at the next event so completions are delivered on time, and the CPU
+ * idles when every live process is blocked.
+ *
+ * @param context     interrupt vectors, ISR delays, external files registry and program cache
+ * @param sched       scheduling policy settings; collects the statistics
+ * @param trace_file  compiled trace of init
+ * @param time        current simulation time
+ * @param init        PCB of the first process
+ * @param execution   execution log the events are recorded in
+ * @param system_status sink the system status snapshots are streamed to
+ *
+ * @return the updated time
+ */
+int schedule_trace(
+    const sim_context& context,
+    scheduler& sched,
+    const compiled_trace& trace_file,
+    int time,
+    PCB init,
+    execution_log& execution,
+    output_sink& system_status) {
+
+    int current_time = time;
+    sched.start = time;
+
+    std::deque<sim_process> processes;  //stable references while FORK adds processes
+    processes.push_back({init, &trace_file, 0, false, 0, time});
+
+    ready_queue ready(sched.policy);
+    event_calendar calendar;
+    std::vector<int> device_free(context.delays.size(), 0);   //when each device finishes its queued I/O
+    std::vector<sim_frame> no_frames;   //swapping is off in scheduler mode: nothing to swap out
+
+    // The other live processes, for the system status snapshots
+    auto others = [&](int running) {
+        std::vector<PCB> list;
+        for (size_t i = 0; i < processes.size(); i++) {
+            if ((int)i != running && processes[i].finish < 0) {
+                list.push_back(processes[i].current);
+            }
+        }
+        return list;
+    };
+
+    int running = 0;
+    int last_run = 0;
+    int quantum_left = sched.quantum_of(processes[0]);
+    processes[0].first_run = time;
+
+    // Puts the running process back in the ready queue
+    auto preempt = [&]() {
+        processes[running].ready_since = current_time;
+        ready.push(running, processes[running]);
+        running = -1;
+    };
+
+    // Event handlers
+    auto fire = [&](const sim_event& event) {
+        switch (event.type) {
+        case event_type::IO_COMPLETE: {
+            sim_process& waiter = processes[event.process];
+            execution.record(current_time, 0, log_event::IO_COMPLETE, waiter.current.PID);
+            waiter.ready_since = event.time;
+            ready.push(event.process, waiter);
+            break;
+        }
+        }
+    };
+
+    while (true) {
+        // Deliver the events that are due; a better process made ready preempts the running one
+        if (!calendar.empty() && calendar.next_time() <= current_time) {
+            while (!calendar.empty() && calendar.next_time() <= current_time) {
+                fire(calendar.pop());
+            }
+            if (running >= 0 && ready.preempts(processes[running])) {
+                preempt();
+            }
+        }
+
+        if (running < 0) {
+            if (ready.empty()) {
+                if (calendar.empty()) {
+                    break;
+                }
+
+                // Every live process is blocked: idle until the next event
+                int idle = calendar.next_time() - current_time;
+                execution.record(current_time, idle, log_event::CPU_IDLE);
+                current_time += idle;
+                sched.idle += idle;
+                continue;
+            }
+
+            // Dispatch
+            int next = ready.pop();
+            sim_process& process = processes[next];
+            process.waiting += current_time - process.ready_since;
+            if (next != last_run) {
+                current_time = intr_boilerplate(execution, current_time, sched.timer_vector,
+                                                context.context_save_time);
+                execution.record(current_time, 0, log_event::DISPATCH, process.current.PID);
+                execution.record(current_time, 1, log_event::IRET);
+                current_time += 1;
+                sched.context_switches++;
+            }
+            if (process.first_run < 0) {
+                process.first_run = current_time;
+            }
+            running = next;
+            last_run = next;
+            quantum_left = sched.quantum_of(process);
+        }
+
+        sim_process& process = processes[running];
+
+        // CPU burst in progress: run it until it ends, the quantum does or the next event fires
+        if (process.remaining > 0) {
+            if (!calendar.empty() && calendar.next_time() <= current_time) {
+                continue; // events fell due during the dispatch: deliver them first
+            }
+            int slice = std::min(process.remaining, quantum_left);
+            if (!calendar.empty()) {
+                slice = std::min(slice, calendar.next_time() - current_time);
+            }
+            current_time = run_cpu(context, process.current, current_time, slice, execution);
+            process.remaining -= slice;
+            quantum_left -= slice;
+
+            if (quantum_left == 0) {
+                if (sched.policy == scheduling_policy::MLFQ && process.level + 1 < mlfq_levels) {
+                    process.level++; // used its whole quantum: demote
+                }
+                if (ready.empty()) {
+                    quantum_left = sched.quantum_of(process);
+                } else {
+                    preempt();
+                }
+            }
+            continue;
+        }
+
+        // Process finished its trace
+        if (process.cursor >= process.trace->code.size()) {
+            drop_reference(context, process.current);
+            process.finish = current_time;
+            sched.finished(process);
+            running = -1;
+            continue;
+        }
+
+        const instruction& ins = process.trace->code[process.cursor++];
+        int duration_intr = ins.operand;
+
+        switch (ins.op) {
+        case opcode::CPU: {
+            write_shared_memory(context, no_frames, 0, process.current, process.borrowed, duration_intr, current_time,
+                                execution);
+            if (duration_intr > 0) {
+                process.remaining = duration_intr;
+            } else {
+                current_time = run_cpu(context, process.current, current_time, 0, execution);
+            }
+            break;
+        }
+        case opcode::SYSCALL: {
+            if (!sched.async_io) {
+                current_time = interrupt_service(context, current_time, duration_intr, log_event::SYSCALL_ISR,
+                                                 execution);
+                break;
+            }
+
+            // The ISR starts the device; the process blocks until it completes
+            current_time = intr_boilerplate(execution, current_time, duration_intr, context.context_save_time);
+            execution.record(current_time, 1, log_event::IO_REQUEST, duration_intr);
+            current_time += 1;
+            execution.record(current_time, 1, log_event::IRET);
+            current_time += 1;
+
+            int io_start = std::max(current_time, device_free[duration_intr]);
+            device_free[duration_intr] = io_start + context.delays[duration_intr];
+            calendar.schedule(device_free[duration_intr], event_type::IO_COMPLETE, running, duration_intr);
+            sched.io_requests++;
+            running = -1;
+            break;
+        }
+        case opcode::END_IO: {
+            current_time = interrupt_service(context, current_time, duration_intr, log_event::ENDIO_ISR, execution);
+            break;
+        }
+        case opcode::FORK: {
+            // Every live process, the parent included, is another process to the child
+            bool borrowed;
+            PCB child = fork_process(context, no_frames, 0, process.current, borrowed, ins, current_time, execution,
+                                     system_status, others(-1));
+
+            // The child starts in its section; the parent carries on after IF_PARENT
+            const fork_block& block = process.trace->forks[ins.target];
+            process.cursor = block.parent_resume;
+
+            processes.push_back({child, process.trace, block.child_begin, borrowed, process.priority, current_time});
+            processes.back().ready_since = current_time;
+            ready.push(processes.size() - 1, processes.back());
+
+            if (ready.preempts(process)) {
+                preempt();
+            }
+            break;
+        }
+        case opcode::IF_PARENT: {
+            // Only a child reaches IF_PARENT: skip the parent section
+            process.cursor = ins.target;
+            break;
+        }
+        case opcode::EXEC: {
+            const compiled_trace* exec_trace = exec_program(context, no_frames, 0, process.current, process.borrowed,
+                                                            ins, current_time, execution, system_status,
+                                                            others(running));
+            if (!exec_trace) {
+                process.cursor = process.trace->code.size();
+                break;
+            }
+
+            process.trace = exec_trace;
+            process.cursor = 0;
+            process.priority = context.registry.priority_of(ins.program);
+            if (ready.preempts(process)) {
+                preempt();
+            }
+            break;
+        }
+        default:
+            // IF_CHILD / ENDIF markers and malformed lines
+            break;
+        }
+    }
+
+    sched.end = current_time;
+    return current_time;
+}
+
+#endif
@@ -0,0 +1,167 @@
+/**
+ * @file simulation.hpp
+ *
+ * The simulator class: one run of a trace with its own tables, options,
+ * state and outputs, in either the frame stack or the scheduler mode.
+ */
+
+#ifndef SIMULATION_HPP_
+#define SIMULATION_HPP_
+
+#include <scheduler.hpp>
+
+//Input tables, parsed once and shared read-only by every run
+struct sim_tables {
+    std::vector<std::string>    vectors;
+    std::vector<int>            delays;
+    program_registry            registry;
+    std::vector<std::string>    positions;  //memory position of each vector
+};
+
+/**
+ * \brief one simulation and everything it owns
+ *
+ * Owns its copy of the tables, its options, its state (main memory, PID
+ * counter, random delays) and its output sinks, and touches nothing global,
+ * so any number of simulators can run at once on any threads. A simulator
+ * runs one trace.
+ *
+ */
+class simulator {
+public:
+    /**
+     * @param tables          vector, device and external files tables
+     * @param options         simulator options
+     * @param seed            seed of the random delays
+     * @param execution_file  where the execution log goes; empty for nowhere
+     * @param status_file     where the system status snapshots go; empty for nowhere
+     * @param tally           if given, events are added up here instead of being logged
+     */
+    simulator(const sim_tables& tables, const sim_options& options, unsigned int seed,
+              const std::string& execution_file, const std::string& status_file, event_tally* tally = nullptr):
+        tables(tables),
+        options(options),
+        execution_output(execution_file.empty() ? nullptr : execution_file.c_str()),
+        system_status(status_file.empty() ? nullptr : status_file.c_str()),
+        execution(execution_output, this->tables.vectors, this->tables.positions, options.binary_output, tally),
+        seed(seed),
+        swap{options.swap_victim, options.swap_rate, options.swap_vector},
+        sharing{options.fork_mode, options.cow_write_burst, options.copy_rate, {}},
+        sched{options.scheduler, options.quantum, options.timer_vector, options.async_io} {
+        state.memory = make_memory(options);
+        state.random.seed(seed);
+    }
+
+    simulator(const simulator&) = delete;
+    simulator& operator=(const simulator&) = delete;
+
+    /**
+     * \brief runs a trace and reports on it
+     *
+     * @param trace_text  the trace
+     * @param report      stream the end of run report is written to
+     *
+     * @return whether the trace ran
+     */
+    bool run(std::string_view trace_text, std::ostream& report) {
+        if (!simulate(trace_text)) {
+            return false;
+        }
+
+        // Output results
+        execution_output.close(report);
+        system_status.close(report);
+
+        report << std::endl;
+        state.memory->report(report);
+        if (options.swapping) {
+            swap.report(report);
+        }
+        if (options.fork_mode != fork_memory::SHARED) {
+            sharing.report(report);
+        }
+        if (options.scheduler != scheduling_policy::NONE) {
+            sched.report(report);
+        }
+        state.allocation_latency.report(report, "\nMemory allocation latency");
+        report << "\nProgram cache: " << cache.hits << " hit(s), " << cache.misses << " miss(es)" << std::endl;
+        report << "Random delays seed: " << seed << " (--seed " << seed << " reproduces this run)" << std::endl;
+        return true;
+    }
+
+    //Compiles and runs a trace; see simulate(const compiled_trace&)
+    bool simulate(std::string_view trace_text) {
+        return simulate(compile_trace(trace_text, tables.registry.programs,
+                                      interrupt_count(tables.vectors, tables.delays)));
+    }
+
+    /**
+     * \brief runs a trace, streaming the execution log and system status to the sinks
+     *
+     * @param trace_file  the trace, compiled against the registry of the tables this simulator was given
+     *
+     * @return whether the trace ran; end_time() then tells when it finished
+     */
+    bool simulate(const compiled_trace& trace_file) {
+        PCB current(0, -1, "init", 1, -1);
+        if (!allocate_memory(state, &current)) {
+            std::cerr << "ERROR! Memory allocation failed for init!" << std::endl;
+            return false;
+        }
+
+        std::vector<PCB> wait_queue;
+
+        // Start simulation
+        sim_context context{tables.vectors, tables.delays, tables.registry, cache, state};
+        context.context_save_time = options.context_save_time;
+        context.load_rate = options.load_rate;
+        context.compaction = options.compaction;
+        context.relocation_rate = options.relocation_rate;
+        if (options.swapping) {
+            context.swapping = &swap;
+        }
+        context.sharing = &sharing;
+        if (options.model == memory_model::PAGED) {
+            context.paging = static_cast<paged_memory*>(state.memory.get());
+            context.fault_vector = options.fault_vector;
+            context.touch_interval = options.touch_interval;
+        }
+        if (options.scheduler != scheduling_policy::NONE) {
+            context.scheduled = true;
+            finish = schedule_trace(context, sched, trace_file, 0, current, execution, system_status);
+        } else {
+            finish = simulate_trace(
+                context,
+                trace_file,
+                0,
+                0,
+                current,
+                wait_queue,
+                execution,
+                system_status
+            );
+        }
+        return true;
+    }
+
+    //Simulated time the trace finished at
+    int end_time() const {
+        return finish;
+    }
+
+private:
+    sim_tables      tables;     //own copy: compiling and EXEC intern program names into the registry
+    sim_options     options;
+    sim_state       state;
+    output_sink     execution_output;
+    output_sink     system_status;
+    execution_log   execution;
+    unsigned int    seed;
+    program_cache   cache;
+    swap_space      swap;
+    fork_sharing    sharing;
+    scheduler       sched;
+    int             finish = 0;
+};
+
+#endif
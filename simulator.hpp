@@ -0,0 +1,683 @@
+/**
+ * @file simulator.hpp
+ *
+ * The trace interpreter: runs compiled traces against the vector, device and
+ * external file tables, simulating FORK/EXEC and the interrupts they raise.
+ */
+
+#ifndef SIMULATOR_HPP_
+#define SIMULATOR_HPP_
+
+#include <interrupts.hpp>
+#include <memory>
+
+/**
+ * \brief compiled program traces, loaded once per run
+ *
+ * EXEC looks programs up here by interned id instead of reading and compiling
+ * <program>.txt every time. Programs whose file cannot be opened are remembered
+ * as missing, so they are not retried either.
+ * 
+ */
+struct program_cache {
+    std::vector<std::unique_ptr<compiled_trace>>    traces;     //by program id, null until loaded
+    std::vector<bool>                               missing;    //by program id
+    size_t                                          hits = 0;
+    size_t                                          misses = 0;
+
+    //Returns the compiled trace of a program, or nullptr if its file cannot be opened.
+    //interrupts is how many interrupts the vector and device tables both have.
+    const compiled_trace* load(int program, program_table& programs, size_t interrupts) {
+        if((size_t)program < traces.size() && (traces[program] || missing[program])) {
+            hits++;
+            return traces[program].get();
+        }
+
+        misses++;
+        const std::string& program_name = programs.names[program];
+        mapped_file trace_file(program_name + ".txt");
+
+        std::unique_ptr<compiled_trace> trace;
+        if(trace_file.is_open()) {
+            trace = std::make_unique<compiled_trace>(compile_trace(trace_file.contents(), programs, interrupts));
+        }
+
+        //compiling may intern new programs, so size the table afterwards
+        if(traces.size() < programs.names.size()) {
+            traces.resize(programs.names.size());
+            missing.resize(programs.names.size());
+        }
+        missing[program] = !trace;
+        traces[program] = std::move(trace);
+        return traces[program].get();
+    }
+};
+
+//Backing store of the swapping mode: its settings and the swap traffic
+struct swap_space {
+    swap_policy                         victim;
+    int                                 rate;               //transfer time per Mb
+    int                                 vector;             //interrupt vector of swap-in completions
+    size_t                              swap_outs = 0;
+    size_t                              swap_ins = 0;
+    size_t                              swapped_out_mb = 0;
+    size_t                              swapped_in_mb = 0;
+    size_t                              failed_swap_ins = 0;
+
+    void report(std::ostream& out) const {
+        out << "Swapping: " << swap_outs << " swap out(s) (" << swapped_out_mb << " Mb), " << swap_ins
+            << " swap in(s) (" << swapped_in_mb << " Mb), " << failed_swap_ins << " failed swap in(s)" << std::endl;
+    }
+};
+
+//Reference counts of memory shared by FORKed processes, and what copying it cost
+struct fork_sharing {
+    fork_memory                         mode;
+    int                                 write_burst;        //cow: CPU bursts this long write memory, 0 for never
+    int                                 copy_rate;          //copy time per Mb
+    std::unordered_map<int, int>        references;         //partition number -> processes using it, if more than one
+    size_t                              forks = 0;
+    size_t                              forked_mb = 0;      //memory of the parents at FORK
+    size_t                              copies = 0;
+    size_t                              copied_mb = 0;
+    size_t                              failed_copies = 0;  //no memory for the copy
+
+    void report(std::ostream& out) const {
+        static const char* mode_names[] = {"shared", "eager", "cow"};
+        out << "Fork memory (" << mode_names[(int)mode] << "): " << forks << " fork(s) of " << forked_mb << " Mb, "
+            << copies << " cop(ies) of " << copied_mb << " Mb taking " << copied_mb * copy_rate << " ms, "
+            << failed_copies << " failed cop(ies)" << std::endl;
+        out << "  never copied: " << forked_mb - copied_mb << " Mb, " << (forked_mb - copied_mb) * copy_rate
+            << " ms" << std::endl;
+    }
+};
+
+//Tables shared by every process of the simulation. They are held by reference,
+//so FORK/EXEC never copies them.
+struct sim_context {
+    const std::vector<std::string>&     vectors;
+    const std::vector<int>&             delays;
+    program_registry&                   registry;   //external files; its program table grows as EXEC loads programs
+    program_cache&                      cache;      //compiled programs for EXEC
+    sim_state&                          state;      //memory, PID counter and random delays of this simulation
+    paged_memory*                       paging = nullptr;   //paged memory model only: CPU bursts reference pages
+    int                                 fault_vector = 14;  //interrupt vector of page faults
+    int                                 touch_interval = 5; //CPU time between page references
+    bool                                compaction = false; //compact memory and retry when an EXEC does not fit
+    int                                 relocation_rate = 2;//compaction time per Mb relocated
+    swap_space*                         swapping = nullptr; //swapping mode only: waiting processes can be swapped out
+    fork_sharing*                       sharing = nullptr;  //how FORKed children get memory; legacy sharing if null
+    bool                                scheduled = false;  //processes run concurrently under the scheduler
+    int                                 context_save_time = 10; //time intr_boilerplate takes to save the context
+    int                                 load_rate = 15;     //EXEC load time per Mb
+};
+
+// Whether processes own their memory, reference counted while FORKed children share it,
+// rather than the legacy partition sharing where a child's EXEC or exit frees its parent's memory.
+// A paged address space is always reference counted: the parent keeps touching its pages.
+bool owns_memory(const sim_context& context) {
+    return context.sharing && (context.swapping || context.scheduled || context.paging
+                               || context.sharing->mode != fork_memory::SHARED);
+}
+
+// Another process now uses the memory of process
+void add_reference(const sim_context& context, const PCB& process) {
+    if (process.partition_number >= 0) {
+        context.sharing->references.try_emplace(process.partition_number, 1).first->second++;
+    }
+}
+
+// Process stops using its memory, which is freed once no process uses it
+void drop_reference(const sim_context& context, PCB& process) {
+    auto& references = context.sharing->references;
+    auto found = references.find(process.partition_number);
+    if (found != references.end()) {
+        if (--found->second == 1) {
+            references.erase(found);
+        }
+        process.partition_number = -1;
+        return;
+    }
+    free_memory(context.state, &process);
+}
+
+//One process on the simulator's explicit stack. A FORK pushes the child on top
+//of its waiting parent; an EXEC replaces the trace of the frame in place.
+struct sim_frame {
+    const compiled_trace*               trace;      //the main trace or one owned by the program cache
+    size_t                              cursor;     //next instruction to run
+    PCB                                 current;
+    std::vector<PCB>                    wait_queue;
+    bool                                borrowed = false;   //a child still using its parent's memory (until it EXECs)
+    bool                                swapped_out = false;
+};
+
+// Frame owning the memory that frame index uses: itself, or the parent it borrows from.
+// Walks the borrowing frames, so callers only look it up once they need it. Without
+// frames (scheduler mode) there is nothing to swap out and 0 is returned.
+size_t memory_owner(const std::vector<sim_frame>& frames, size_t index) {
+    if (frames.empty()) {
+        return 0;
+    }
+    while (frames[index].borrowed) {
+        index--;
+    }
+    return index;
+}
+
+// Waiting frames whose memory could be swapped out, the one the policy picks first at the front.
+// Frames from keep up are in use.
+std::vector<size_t> swap_candidates(const std::vector<sim_frame>& frames, size_t keep, swap_policy policy) {
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < keep; i++) {
+        const sim_frame& candidate = frames[i];
+        if (candidate.borrowed || candidate.swapped_out || candidate.current.partition_number < 0) {
+            continue; // not its own memory, or none to give back
+        }
+        candidates.push_back(i);
+    }
+    if (policy == swap_policy::NEWEST) {
+        std::reverse(candidates.begin(), candidates.end());
+    } else if (policy == swap_policy::LARGEST) {
+        std::stable_sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b) {
+            return frames[a].current.size > frames[b].current.size;
+        });
+    }
+    return candidates;
+}
+
+// Sets the partition of a memory owner and of the children above it still borrowing its memory.
+// Returns how many processes use it.
+size_t set_shared_partition(std::vector<sim_frame>& frames, size_t owner, int partition_number) {
+    size_t users = 1;
+    frames[owner].current.partition_number = partition_number;
+    for (size_t i = owner + 1; i < frames.size() && frames[i].borrowed; i++) {
+        frames[i].current.partition_number = partition_number;
+        users++;
+    }
+    return users;
+}
+
+/**
+ * Allocates memory for process, swapping waiting processes out if it does not
+ * fit. The memory model is asked first whether the process would fit with every
+ * candidate swapped out; if not, nothing is swapped. Otherwise candidates the
+ * policy picks last are spared while the process still fits without them, and
+ * the rest are swapped out. Frames from keep up are never swapped out, so keep
+ * must not be above the owner of any memory the process still uses. Each swap
+ * out is logged and its transfer time charged.
+ *
+ * @return true if the allocation succeeded
+ */
+bool allocate_with_swapping(const sim_context& context, std::vector<sim_frame>& frames, size_t keep, PCB& process,
+                            int& current_time, execution_log& execution) {
+    swap_space& swap = *context.swapping;
+
+    if (allocate_memory(context.state, &process)) {
+        return true;
+    }
+
+    std::vector<size_t> victims = swap_candidates(frames, keep, swap.victim);
+    std::vector<int> released;
+    for (size_t victim : victims) {
+        released.push_back(frames[victim].current.partition_number);
+    }
+    if (!context.state.memory->fits_after(process.size, released)) {
+        return false;
+    }
+    for (size_t i = victims.size(); i-- > 0;) {
+        int spared = released[i];
+        released.erase(released.begin() + i);
+        if (context.state.memory->fits_after(process.size, released)) {
+            victims.erase(victims.begin() + i); // not needed for the fit
+        } else {
+            released.insert(released.begin() + i, spared);
+        }
+    }
+
+    for (size_t victim : victims) {
+        PCB& waiting = frames[victim].current;
+        int transfer_time = waiting.size * swap.rate;
+        execution.record(current_time, transfer_time, log_event::SWAP_OUT, waiting.PID);
+        current_time += transfer_time;
+
+        // The whole memory goes, even if children waiting above still borrow it
+        context.sharing->references.erase(waiting.partition_number);
+        free_memory(context.state, &waiting);
+        set_shared_partition(frames, victim, -1);
+        frames[victim].swapped_out = true;
+        swap.swap_outs++;
+        swap.swapped_out_mb += waiting.size;
+    }
+    return allocate_memory(context.state, &process);
+}
+
+/**
+ * Brings the memory of the frame on top back in if it, or the parent whose
+ * memory it borrows, was swapped out. The transfer is an I/O: it completes
+ * with an interrupt on the swap vector, whose ISR reads the process back.
+ *
+ * @return the updated time
+ */
+int swap_in(const sim_context& context, std::vector<sim_frame>& frames, int current_time, execution_log& execution) {
+    size_t owner = memory_owner(frames, frames.size() - 1);
+    if (!frames[owner].swapped_out) {
+        return current_time;
+    }
+
+    swap_space& swap = *context.swapping;
+    PCB& process = frames[owner].current;
+    current_time = intr_boilerplate(execution, current_time, swap.vector, context.context_save_time);
+
+    if (allocate_with_swapping(context, frames, owner, process, current_time, execution)) {
+        int transfer_time = process.size * swap.rate;
+        execution.record(current_time, transfer_time, log_event::SWAP_IN_ISR, process.PID);
+        current_time += transfer_time;
+
+        size_t users = set_shared_partition(frames, owner, process.partition_number);
+        if (users > 1) {
+            context.sharing->references[process.partition_number] = users;
+        }
+        frames[owner].swapped_out = false;
+        swap.swap_ins++;
+        swap.swapped_in_mb += process.size;
+    } else {
+        std::cerr << "ERROR! Swap in failed for PID " << process.PID << std::endl;
+        swap.failed_swap_ins++;
+    }
+
+    execution.record(current_time, 1, log_event::IRET);
+    current_time += 1;
+    return current_time;
+}
+
+// Allocates memory for process, swapping waiting processes out if swapping is on
+bool allocate_process(const sim_context& context, std::vector<sim_frame>& frames, size_t keep, PCB& process,
+                      int& current_time, execution_log& execution) {
+    if (context.swapping) {
+        return allocate_with_swapping(context, frames, keep, process, current_time, execution);
+    }
+    return allocate_memory(context.state, &process);
+}
+
+/**
+ * Gives process a copy of the memory it shares: allocates its own and logs
+ * the copy. The process stops referencing the shared memory only if the copy
+ * could be made.
+ *
+ * @return true if the copy was made
+ */
+bool copy_shared_memory(const sim_context& context, std::vector<sim_frame>& frames, size_t keep, PCB& process,
+                        int& current_time, execution_log& execution) {
+    fork_sharing& sharing = *context.sharing;
+    PCB copy = process;
+    copy.partition_number = -1;
+    if (!allocate_process(context, frames, keep, copy, current_time, execution)) {
+        std::cerr << "ERROR! Memory allocation failed for a copy of PID " << process.PID << "'s memory" << std::endl;
+        sharing.failed_copies++;
+        return false;
+    }
+
+    int copy_time = process.size * sharing.copy_rate;
+    execution.record(current_time, copy_time, log_event::COPY_MEMORY, process.size);
+    current_time += copy_time;
+    sharing.copies++;
+    sharing.copied_mb += process.size;
+
+    drop_reference(context, process);
+    process.partition_number = copy.partition_number;
+    return true;
+}
+
+/**
+ * \brief CPU burst in the paged memory model
+ *
+ * The process references a page every touch_interval of CPU time. A page fault
+ * interrupts the burst: it goes through the usual interrupt boilerplate on the
+ * page fault vector, and the burst resumes after the ISR returns.
+ *
+ * @return the updated time
+ */
+int paged_cpu_burst(const sim_context& context, const PCB& process, int current_time, int duration,
+                    execution_log& execution) {
+    int done = 0;           //CPU time already logged
+    bool logged = false;
+
+    for (int offset = 0; offset < std::max(duration, 1); offset += context.touch_interval) {
+        unsigned int page;
+        if (context.paging->touch(process.partition_number, page) != page_access::PAGE_FAULT) {
+            continue; // a hit, or counted as an unmapped reference
+        }
+
+        if (offset > done) {
+            execution.record(current_time, offset - done, log_event::CPU_BURST);
+            current_time += offset - done;
+            done = offset;
+            logged = true;
+        }
+
+        current_time = intr_boilerplate(execution, current_time, context.fault_vector, context.context_save_time);
+
+        int fault_time = context.delays[context.fault_vector];
+        execution.record(current_time, fault_time, log_event::PAGE_FAULT_ISR, page);
+        current_time += fault_time;
+
+        execution.record(current_time, 1, log_event::IRET);
+        current_time += 1;
+    }
+
+    if (duration > done || !logged) {
+        execution.record(current_time, duration - done, log_event::CPU_BURST);
+        current_time += duration - done;
+    }
+    return current_time;
+}
+
+// SYSCALL / END_IO: the ISR of the device on vector runs for the device's delay
+int interrupt_service(const sim_context& context, int current_time, int vector, log_event isr, execution_log& execution) {
+    current_time = intr_boilerplate(execution, current_time, vector, context.context_save_time);
+
+    execution.record(current_time, context.delays[vector], isr);
+    current_time += context.delays[vector];
+
+    execution.record(current_time, 1, log_event::IRET);
+    current_time += 1;
+    return current_time;
+}
+
+// Runs duration of CPU time for process, referencing pages in the paged memory model
+int run_cpu(const sim_context& context, const PCB& process, int current_time, int duration, execution_log& execution) {
+    if (context.paging) {
+        return paged_cpu_burst(context, process, current_time, duration, execution);
+    }
+
+    execution.record(current_time, duration, log_event::CPU_BURST);
+    return current_time + duration;
+}
+
+// Copy-on-write: a CPU burst long enough to write memory gives a process whose memory
+// other processes still reference, the parent as well as a borrowing child, its own
+// copy. process runs in frame index; frames from its memory owner up are never swapped out.
+void write_shared_memory(const sim_context& context, std::vector<sim_frame>& frames, size_t index, PCB& process,
+                         bool& borrowed, int duration, int& current_time, execution_log& execution) {
+    if (owns_memory(context) && context.sharing->mode == fork_memory::COW
+        && context.sharing->write_burst > 0 && duration >= context.sharing->write_burst
+        && context.sharing->references.count(process.partition_number)) {
+        size_t owner = memory_owner(frames, index);
+        if (copy_shared_memory(context, frames, owner, process, current_time, execution)) {
+            borrowed = false;
+        }
+    }
+}
+
+// Gives a FORKed child of the process in frame index its memory: a reference to its
+// parent's, or an eager copy. Returns whether the child shares its parent's memory.
+bool fork_child_memory(const sim_context& context, std::vector<sim_frame>& frames, size_t index, PCB& child,
+                       int& current_time, execution_log& execution) {
+    if (!owns_memory(context)) {
+        return true;
+    }
+
+    add_reference(context, child);
+    context.sharing->forks++;
+    context.sharing->forked_mb += child.size;
+    if (context.sharing->mode == fork_memory::EAGER) {
+        return !copy_shared_memory(context, frames, memory_owner(frames, index), child, current_time, execution);
+    }
+    return true;
+}
+
+/**
+ * FORK (vector 2): clones parent into a new child process. Logs the ISR,
+ * gives the child its memory, and snapshots the system status.
+ *
+ * @param frames    processes that may be swapped out to make room, below the owner of the parent's memory
+ * @param index     frame the parent runs in
+ * @param borrowed  set to whether the child shares its parent's memory
+ * @param others    the other processes, for the snapshot
+ *
+ * @return the child's PCB
+ */
+PCB fork_process(const sim_context& context, std::vector<sim_frame>& frames, size_t index, const PCB& parent,
+                 bool& borrowed, const instruction& ins, int& current_time, execution_log& execution,
+                 output_sink& system_status, const std::vector<PCB>& others) {
+    int duration_intr = ins.operand;
+
+    // Standard FORK (vector 2)
+    current_time = intr_boilerplate(execution, current_time, 2, context.context_save_time);
+
+    // Clone PCB for child process
+    execution.record(current_time, duration_intr, log_event::CLONE_PCB);
+    current_time += duration_intr;
+
+    // Create child PCB (inherits parent info)
+    PCB child(context.state.next_pid++, parent.PID, parent.program_name, parent.size, parent.partition_number);
+
+    // The child shares the parent's memory, unless it gets its own copy right away
+    borrowed = fork_child_memory(context, frames, index, child, current_time, execution);
+
+    execution.record(current_time, 0, log_event::SCHEDULER);
+    execution.record(current_time, 1, log_event::IRET);
+    current_time += 1;
+
+    // Snapshot system state
+    system_status << "time: " << current_time << "; current trace: FORK, " << duration_intr << "\n";
+    system_status << print_PCB(child, others);
+    return child;
+}
+
+/**
+ * EXEC (vector 3): replaces the image of process with the program of ins.
+ * Logs the ISR, swaps the process's memory for the program's, and snapshots
+ * the system status.
+ *
+ * @param frames    processes that may be swapped out to make room, below keep
+ * @param borrowed  whether process shares its parent's memory; cleared
+ * @param others    the other processes, for the snapshot
+ *
+ * @return the program's compiled trace, or nullptr if the process cannot continue
+ */
+const compiled_trace* exec_program(const sim_context& context, std::vector<sim_frame>& frames, size_t keep,
+                                   PCB& process, bool& borrowed, const instruction& ins, int& current_time,
+                                   execution_log& execution, output_sink& system_status, const std::vector<PCB>& others) {
+    int duration_intr = ins.operand;
+    const std::string& program_name = context.registry.programs.names[ins.program];
+
+    // Standard EXEC (vector 3)
+    current_time = intr_boilerplate(execution, current_time, 3, context.context_save_time);
+
+    // Load new program info
+    std::optional<unsigned int> found_size = context.registry.size_of(ins.program);
+    if (!found_size) {
+        // EXEC fails and returns; the process cannot continue
+        std::cerr << "ERROR! " << program_name << " is not in the external files table" << std::endl;
+        execution.record(current_time, 1, log_event::IRET);
+        current_time += 1;
+        return nullptr;
+    }
+    unsigned int program_size = *found_size;
+
+    execution.record(current_time, duration_intr, log_event::PROGRAM_SIZE, program_size);
+    current_time += duration_intr;
+
+    // Simulate loading
+    int load_time = program_size * context.load_rate;
+    execution.record(current_time, load_time, log_event::LOAD_PROGRAM);
+    current_time += load_time;
+
+    // Replace memory and update PCB. Memory still shared with a waiting parent is
+    // only dereferenced: EXEC replaces the image, so nothing needs copying.
+    if (owns_memory(context)) {
+        drop_reference(context, process);
+    } else {
+        free_memory(context.state, &process);
+    }
+    borrowed = false;
+    process.program_name = program_name;
+    process.size = program_size;
+
+    bool allocated = allocate_process(context, frames, keep, process, current_time, execution);
+    if (!allocated && context.compaction) {
+        // Relocate resident programs to coalesce the free space, then retry
+        unsigned int relocated = compact_memory(context.state, program_size);
+        if (relocated > 0) {
+            int relocation_time = relocated * context.relocation_rate;
+            execution.record(current_time, relocation_time, log_event::COMPACTION, relocated);
+            current_time += relocation_time;
+            allocated = allocate_memory(context.state, &process);
+        }
+    }
+    if (!allocated)
+        std::cerr << "ERROR! Memory allocation failed for " << program_name << std::endl;
+
+    // Random small delays
+    int mark_time = (context.state.random.next() % 10) + 1;
+    execution.record(current_time, mark_time, log_event::MARK_PARTITION);
+    current_time += mark_time;
+
+    int update_time = (context.state.random.next() % 10) + 1;
+    execution.record(current_time, update_time, log_event::UPDATE_PCB);
+    current_time += update_time;
+
+    execution.record(current_time, 0, log_event::SCHEDULER);
+    execution.record(current_time, 1, log_event::IRET);
+    current_time += 1;
+
+    // Snapshot after EXEC
+    system_status << "time: " << current_time << "; current trace: EXEC " << program_name << ", " << duration_intr << "\n";
+    system_status << print_PCB(process, others);
+
+    // Load new program trace, compiled once per run
+    const compiled_trace* exec_trace = context.cache.load(ins.program, context.registry.programs,
+                                                          interrupt_count(context.vectors, context.delays));
+    if (!exec_trace) {
+        std::cerr << "ERROR! Could not open " << program_name << ".txt" << std::endl;
+    }
+    return exec_trace;
+}
+
+/**
+ * 
+ * Handles CPU bursts, SYSCALLs, END_IO, FORK, and EXEC calls.
+ * Forks create child processes and exec replaces the current process code.
+ * Processes are kept on an explicit frame stack rather than the native one,
+ * so arbitrarily deep FORK trees and EXEC chains only cost one frame each.
+ * 
+ * @param context     interrupt vectors, ISR delays, external files registry and program cache
+ * @param trace_file  compiled trace instructions and FORK jump table
+ * @param start       index of the first instruction to run
+ * @param time        current simulation time
+ * @param current     current process PCB
+ * @param wait_queue  list of waiting PCBs, taken by value: it becomes the wait queue of the first
+ *                    frame, so the caller's list is never changed
+ * @param execution   execution log the events are recorded in
+ * @param system_status sink the system status snapshots are streamed to
+ * 
+ * @return the updated time
+ */
+int simulate_trace(
+    const sim_context& context,
+    const compiled_trace& trace_file, 
+    size_t start,
+    int time, 
+    PCB current, 
+    std::vector<PCB> wait_queue,
+    execution_log& execution,
+    output_sink& system_status) {
+
+    int current_time = time;
+
+    std::vector<sim_frame> frames;
+    frames.push_back({&trace_file, start, current, std::move(wait_queue)});
+
+    while (!frames.empty()) {
+        sim_frame& frame = frames.back();
+
+        // Process finished its trace: resume the parent waiting on it
+        if (frame.cursor >= frame.trace->code.size()) {
+            if (owns_memory(context)) {
+                // Parents keep their memory while they wait: the child only drops its reference
+                drop_reference(context, frame.current);
+                frames.pop_back();
+                if (!frames.empty() && context.swapping) {
+                    current_time = swap_in(context, frames, current_time, execution);
+                }
+                continue;
+            }
+
+            frames.pop_back();
+            if (!frames.empty()) {
+                // The child was cloned from the parent, so this frees the partition they shared
+                PCB child = frames.back().current;
+                free_memory(context.state, &child);
+            }
+            continue;
+        }
+
+        const instruction& ins = frame.trace->code[frame.cursor++];
+        int duration_intr = ins.operand;
+
+        switch (ins.op) {
+        case opcode::CPU: {
+            // CPU burst simulation
+            write_shared_memory(context, frames, frames.size() - 1, frame.current, frame.borrowed,
+                                duration_intr, current_time, execution);
+            current_time = run_cpu(context, frame.current, current_time, duration_intr, execution);
+            break;
+        }
+        case opcode::SYSCALL: {
+            // Handle SYSCALL interrupt
+            current_time = interrupt_service(context, current_time, duration_intr, log_event::SYSCALL_ISR, execution);
+            break;
+        }
+        case opcode::END_IO: {
+            // Handle END_IO interrupt
+            current_time = interrupt_service(context, current_time, duration_intr, log_event::ENDIO_ISR, execution);
+            break;
+        }
+        case opcode::FORK: {
+            // Parent waits while child runs
+            frame.wait_queue.push_back(frame.current);
+
+            bool borrowed;
+            PCB child = fork_process(context, frames, frames.size() - 1, frame.current, borrowed,
+                                     ins, current_time, execution, system_status, frame.wait_queue);
+
+            // Child section was matched at compile time; the parent continues after IF_PARENT
+            const fork_block& block = frame.trace->forks[ins.target];
+            frame.cursor = block.parent_resume;
+
+            // Run the child over its section of the same trace, with no waiting processes
+            sim_frame child_frame{frame.trace, block.child_begin, child, {}, borrowed};
+            frames.push_back(std::move(child_frame));
+            break;
+        }
+        case opcode::IF_PARENT: {
+            // Only a child reaches IF_PARENT: skip the parent section
+            frame.cursor = ins.target;
+            break;
+        }
+        case opcode::EXEC: {
+            const compiled_trace* exec_trace = exec_program(context, frames, frames.size() - 1, frame.current,
+                                                            frame.borrowed, ins, current_time, execution,
+                                                            system_status, frame.wait_queue);
+            if (!exec_trace) {
+                frame.cursor = frame.trace->code.size();
+                break;
+            }
+
+            // EXEC replaces the process image: the frame continues in the new program
+            frame.trace = exec_trace;
+            frame.cursor = 0;
+            break;
+        }
+        default:
+            // IF_CHILD / ENDIF markers and malformed lines
+            break;
+        }
+    }
+
+    return current_time;
+}
+
+#endif